@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "common.h"
+#include "geodesic.h"
+
+using namespace busdb;
+
+namespace {
+    template <typename Func>
+    double MeasureMs(Func func) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // best of a few runs, in millions of distances per second
+    template <typename Func>
+    double Throughput(size_t count, Func func) {
+        double best_ms = MeasureMs(func);
+        for (int run = 0; run < 4; ++run) {
+            best_ms = std::min(best_ms, MeasureMs(func));
+        }
+        return count / 1e3 / best_ms;
+    }
+
+    // stops of a city around (55.6, 37.6), as in the inputs, or anywhere on the globe
+    std::vector<Point> MakePoints(size_t count, bool city, std::mt19937_64& generator) {
+        std::uniform_real_distribution<double> city_latitude(55.4, 55.9), city_longitude(37.3, 37.9);
+        std::uniform_real_distribution<double> latitude(-90, 90), longitude(-180, 180);
+        std::vector<Point> points;
+        points.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            points.push_back(city ? Point{city_latitude(generator), city_longitude(generator)}
+                                  : Point{latitude(generator), longitude(generator)});
+        }
+        return points;
+    }
+
+    // largest difference from busdb::Distance, in meters
+    double MaxError(const std::vector<Point>& points, const std::vector<uint32_t>& from,
+                    const std::vector<uint32_t>& to, const std::vector<DistanceType>& distances) {
+        double max_error = 0;
+        for (size_t i = 0; i < distances.size(); ++i) {
+            const auto expected = Distance(points[from[i]], points[to[i]]);
+            if (std::isnan(expected) != std::isnan(distances[i])) return INFINITY;
+            if (!std::isnan(expected)) max_error = std::max(max_error, std::abs(expected - distances[i]));
+        }
+        return max_error;
+    }
+}
+
+// Compares GeoPoints distances with busdb::Distance they have to be equal to, and their speed.
+// usage: geo_bench [pairs]
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    std::mt19937_64 generator(42);
+
+    std::cout << "points\terror m\tscalar M/s\tone pair M/s\tbatch M/s" << std::endl;
+    for (const bool city: {true, false}) {
+        const auto points = MakePoints(10000, city, generator);
+        GeoPoints geo_points;
+        geo_points.Reserve(points.size());
+        for (const auto& point: points) {
+            geo_points.Add(point);
+        }
+
+        std::uniform_int_distribution<uint32_t> index(0, points.size() - 1);
+        std::vector<uint32_t> from(count), to(count);
+        for (size_t i = 0; i < count; ++i) {
+            from[i] = index(generator);
+            to[i] = index(generator);
+        }
+
+        std::vector<DistanceType> distances(count);
+        const double scalar = Throughput(count, [&] {
+            for (size_t i = 0; i < count; ++i) distances[i] = Distance(points[from[i]], points[to[i]]);
+        });
+        const double one_pair = Throughput(count, [&] {
+            for (size_t i = 0; i < count; ++i) distances[i] = geo_points.Distance(from[i], to[i]);
+        });
+        const double one_pair_error = MaxError(points, from, to, distances);
+        const double batch = Throughput(count, [&] {
+            geo_points.Distances(from.data(), to.data(), count, distances.data());
+        });
+        const double error = std::max(one_pair_error, MaxError(points, from, to, distances));
+
+        std::cout << (city ? "city" : "globe") << '\t' << error << '\t' << scalar << '\t' << one_pair
+                  << '\t' << batch << std::endl;
+        if (error != 0) {
+            std::cout << "distances differ from busdb::Distance" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
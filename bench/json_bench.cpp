@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "json.h"
+#include "json_index.h"
+
+using namespace Json;
+
+namespace {
+    // The input with its base_requests array repeated copies times
+    std::string ScaleInput(std::string_view input, size_t copies) {
+        Reader reader(input);
+        reader.BeginObject();
+        for (std::string_view key; reader.NextKey(key);) {
+            if (key != "base_requests") {
+                reader.Skip();
+                continue;
+            }
+
+            const size_t array_begin = input.find('[', reader.GetOffset());
+            reader.Skip();
+            const size_t array_end = input.rfind(']', reader.GetOffset());
+            const auto items = input.substr(array_begin + 1, array_end - array_begin - 1);
+
+            std::string result(input.substr(0, array_begin + 1));
+            result.reserve(input.size() + items.size() * copies);
+            for (size_t copy = 0; copy < copies; ++copy) {
+                if (copy) result += ',';
+                result += items;
+            }
+            result += input.substr(array_end);
+            return result;
+        }
+        return std::string(input);
+    }
+
+    template <typename Func>
+    double MeasureMs(Func func) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // best of a few runs, in MB/s
+    template <typename Func>
+    double Throughput(size_t size, Func func) {
+        double best_ms = MeasureMs(func);
+        for (int run = 0; run < 4; ++run) {
+            best_ms = std::min(best_ms, MeasureMs(func));
+        }
+        return size / 1e3 / best_ms;
+    }
+}
+
+// Parse throughput of the JSON loader with and without the structural index.
+// usage: json_bench [input_file] [copies of base_requests]
+int main(int argc, char** argv) {
+    const std::string path = argc > 1 ? argv[1] : "test_input.txt";
+    const size_t copies = argc > 2 ? std::atoi(argv[2]) : 100;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "cannot open " << path << std::endl;
+        return 1;
+    }
+    const auto buffer = Buffer::FromStream(file);
+    const auto input = ScaleInput(buffer.View(), copies);
+
+    std::cout << "input: " << input.size() / 1e6 << " MB, vectorized index: "
+              << (StructuralIndex::IsVectorized() ? "yes" : "no") << std::endl;
+
+    std::cout << "index only\t" << Throughput(input.size(), [&] {
+        StructuralIndex index(input);
+        size_t tokens = 0;
+        for (size_t pos = 0; pos < input.size(); pos = *index.NextToken(pos) + 1) {
+            ++tokens;
+        }
+        if (!tokens) std::cout << "no tokens" << std::endl;
+    }) << " MB/s" << std::endl;
+
+    const auto parse = [&input](bool structural_index) {
+        Reader reader(input, structural_index);
+        auto root = reader.ReadNode();
+        reader.Finish();
+        return Document(std::move(root));
+    };
+    std::cout << "same nodes: " << (EqualWithSkip(parse(false), parse(true)) ? "yes" : "NO") << std::endl;
+
+    std::cout << "mode\tskip MB/s\tnodes MB/s\tnodes in arena MB/s" << std::endl;
+    for (const bool structural_index: {false, true}) {
+        const double skip = Throughput(input.size(), [&] {
+            Reader reader(input, structural_index);
+            reader.Skip();
+            reader.Finish();
+        });
+        const double nodes = Throughput(input.size(), [&] {
+            parse(structural_index);
+        });
+        // what Load does, the arena is released at once
+        const double arena_nodes = Throughput(input.size(), [&] {
+            std::pmr::monotonic_buffer_resource arena(input.size());
+            Reader reader(input, structural_index);
+            auto* root = new (arena.allocate(sizeof(Node), alignof(Node))) Node(reader.ReadNode(&arena));
+            reader.Finish();
+            if (!root->index()) std::cout << "array root" << std::endl;
+        });
+        std::cout << (structural_index ? "index" : "scalar") << '\t' << skip << '\t' << nodes
+                  << '\t' << arena_nodes << std::endl;
+    }
+
+    return 0;
+}
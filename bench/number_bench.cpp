@@ -0,0 +1,114 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "numbers.h"
+
+namespace {
+    template <typename Func>
+    double MeasureMs(Func func) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // what the maps and responses print: coordinates, times, ratios, plus arbitrary bit patterns
+    std::vector<double> MakeDoubles(size_t count, std::mt19937_64& generator) {
+        std::uniform_real_distribution<double> coordinate(-180, 180), canvas(0, 1200), ratio(0.5, 3);
+        std::uniform_int_distribution<int> integer(-1000000, 1000000);
+        std::vector<double> values;
+        values.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            switch (i % 5) {
+                case 0: values.push_back(coordinate(generator)); break;
+                case 1: values.push_back(canvas(generator)); break;
+                case 2: values.push_back(ratio(generator)); break;
+                case 3: values.push_back(integer(generator) / 8.0); break;
+                default: {
+                    const uint64_t bits = generator();
+                    double value;
+                    std::memcpy(&value, &bits, sizeof value);
+                    values.push_back(std::isnormal(value) ? value : 0.0);
+                }
+            }
+        }
+        return values;
+    }
+
+    std::vector<std::string> ToStrings(const std::vector<double>& values, int precision) {
+        std::vector<std::string> result;
+        result.reserve(values.size());
+        std::ostringstream out;
+        out.precision(precision);
+        for (const auto value: values) {
+            out.str({});
+            out << value;
+            result.push_back(out.str());
+        }
+        return result;
+    }
+}
+
+// Compares Numbers parsing and formatting with the string and stream based conversions they replaced.
+// usage: number_bench [count]
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    std::mt19937_64 generator(42);
+
+    const auto doubles = MakeDoubles(count, generator);
+    const auto double_strings = ToStrings(doubles, 17);
+    std::vector<std::string> int_strings;
+    int_strings.reserve(count);
+    std::uniform_int_distribution<int> distance(0, 1000000);
+    for (size_t i = 0; i < count; ++i) {
+        int_strings.push_back(std::to_string(distance(generator)));
+    }
+
+    std::cout << "operation\tstd ns\tNumbers ns\tsame" << std::endl;
+
+    {
+        std::vector<double> expected(count), actual(count);
+        const double std_ms = MeasureMs([&] {
+            for (size_t i = 0; i < count; ++i) expected[i] = std::stod(std::string(std::string_view(double_strings[i])));
+        });
+        const double numbers_ms = MeasureMs([&] {
+            for (size_t i = 0; i < count; ++i) actual[i] = *Numbers::ParseDouble(double_strings[i]);
+        });
+        std::cout << "parse double\t" << std_ms * 1e6 / count << '\t' << numbers_ms * 1e6 / count << '\t'
+                  << (expected == actual ? "yes" : "NO") << std::endl;
+    }
+
+    {
+        std::vector<int> expected(count), actual(count);
+        const double std_ms = MeasureMs([&] {
+            for (size_t i = 0; i < count; ++i) expected[i] = std::stoi(std::string(std::string_view(int_strings[i])));
+        });
+        const double numbers_ms = MeasureMs([&] {
+            for (size_t i = 0; i < count; ++i) actual[i] = *Numbers::ParseInt(int_strings[i]);
+        });
+        std::cout << "parse int\t" << std_ms * 1e6 / count << '\t' << numbers_ms * 1e6 / count << '\t'
+                  << (expected == actual ? "yes" : "NO") << std::endl;
+    }
+
+    for (const int precision: {6, 17}) {
+        std::ostringstream expected, actual;
+        expected.precision(precision);
+        actual.precision(precision);
+        const double std_ms = MeasureMs([&] {
+            for (const auto value: doubles) expected << value << ' ';
+        });
+        const double numbers_ms = MeasureMs([&] {
+            for (const auto value: doubles) actual << Numbers::Double{value} << ' ';
+        });
+        std::cout << "print %." << precision << "g\t" << std_ms * 1e6 / count << '\t' << numbers_ms * 1e6 / count
+                  << '\t' << (expected.str() == actual.str() ? "yes" : "NO") << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "graph.h"
+#include "router.h"
+
+using namespace Graph;
+
+namespace {
+    // Same shape as DataBase::BuildRoutes produces: a wait edge per stop
+    // and bus edges from every stop of a route to all the following ones
+    DirectedWeightedGraph<double> MakeGraph(size_t stop_count, std::mt19937& generator) {
+        DirectedWeightedGraph<double> graph(stop_count * 2);
+        for (VertexId stop = 0; stop < stop_count; ++stop) {
+            graph.AddEdge({stop + stop_count, stop, 6});
+        }
+
+        std::uniform_int_distribution<size_t> stop_distribution(0, stop_count - 1);
+        std::uniform_real_distribution<double> time_distribution(0.5, 5);
+        const size_t bus_count = stop_count / 3 + 1;
+        for (size_t bus = 0; bus < bus_count; ++bus) {
+            std::vector<VertexId> stops(8);
+            for (auto& stop: stops) stop = stop_distribution(generator);
+
+            for (size_t from = 0; from + 1 < stops.size(); ++from) {
+                double time = 0;
+                for (size_t to = from + 1; to < stops.size(); ++to) {
+                    time += time_distribution(generator);
+                    graph.AddEdge({stops[from], stops[to] + stop_count, time});
+                }
+            }
+        }
+
+        return graph;
+    }
+
+    template <typename Func>
+    double MeasureMs(Func func) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool SameRoutes(const Router<double>& left, const Router<double>& right, size_t vertex_count) {
+        auto left_workspace = left.CreateWorkspace(), right_workspace = right.CreateWorkspace();
+        std::vector<EdgeId> left_edges, right_edges;
+        for (VertexId from = 0; from < vertex_count; ++from) {
+            for (VertexId to = 0; to < vertex_count; ++to) {
+                const auto left_weight = left.BuildRoute(from, to, left_workspace, left_edges);
+                const auto right_weight = right.BuildRoute(from, to, right_workspace, right_edges);
+                if (left_weight != right_weight || left_edges != right_edges) return false;
+            }
+        }
+        return true;
+    }
+}
+
+// Compares all-pairs precomputation modes of Graph::Router as the number of stops grows.
+// usage: router_bench [max_stop_count]
+int main(int argc, char** argv) {
+    const size_t max_stop_count = argc > 1 ? std::atoi(argv[1]) : 1600;
+    std::mt19937 generator(42);
+
+    std::cout << "stops\tall_pairs ms\tall_pairs_blocked ms\tspeed-up\tsame routes\tfloat blocked ms" << std::endl;
+    for (size_t stop_count = 100; stop_count <= max_stop_count; stop_count *= 2) {
+        const FrozenGraph<double> graph(MakeGraph(stop_count, generator));
+
+        std::unique_ptr<Router<double>> plain, blocked;
+        const double plain_ms = MeasureMs([&] {
+            plain = std::make_unique<Router<double>>(graph, Router<double>::Mode::ALL_PAIRS);
+        });
+        const double blocked_ms = MeasureMs([&] {
+            blocked = std::make_unique<Router<double>>(graph, Router<double>::Mode::ALL_PAIRS_BLOCKED);
+        });
+
+        const bool same = SameRoutes(*plain, *blocked, graph.GetVertexCount());
+        plain.reset();
+        blocked.reset();
+
+        const double float_ms = MeasureMs([&] {
+            Router<double>(graph, Router<double>::Mode::ALL_PAIRS_BLOCKED, Router<double>::MatrixWeight::FLOAT);
+        });
+
+        std::cout << stop_count << '\t' << plain_ms << '\t' << blocked_ms << '\t' << plain_ms / blocked_ms
+                  << '\t' << (same ? "yes" : "NO") << '\t' << float_ms << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,261 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <list>
+#include <optional>
+#include <random>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "common.h"
+#include "database.h"
+#include "route.h"
+
+using namespace busdb;
+
+namespace {
+    template <typename Func>
+    double MeasureMs(Func func) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct StopRequest {
+        std::string name;
+        Point location;
+        std::list<std::pair<std::string, int>> distances;
+    };
+
+    struct BusRequest {
+        std::string name;
+        std::vector<std::string> stops;
+        bool is_roundtrip;
+    };
+
+    // base requests and the ones that come after routes are built
+    struct Requests {
+        std::vector<StopRequest> stops;
+        std::vector<BusRequest> buses;
+        std::vector<std::variant<StopRequest, BusRequest>> added;
+        std::vector<std::string> stop_names;
+    };
+
+    std::string StopName(size_t stop) {
+        return "Stop " + std::to_string(stop);
+    }
+
+    // Stops of a city with road distances a bit longer than the line, buses over random stops.
+    // Some added buses copy the stops of a base bus under a name before or after it, so they tie with it
+    Requests MakeRequests(size_t stop_count, size_t added_count, std::mt19937& generator) {
+        Requests requests;
+        std::uniform_real_distribution<double> latitude(55.5, 55.8), longitude(37.4, 37.8), road_factor(1.0, 1.5);
+        std::uniform_int_distribution<size_t> stop_distribution(0, stop_count - 1), stops_per_bus(3, 9);
+        std::bernoulli_distribution coin(0.5);
+
+        std::vector<Point> locations;
+        for (size_t stop = 0; stop < stop_count; ++stop) {
+            locations.push_back({latitude(generator), longitude(generator)});
+        }
+        const auto road_distance = [&](size_t from, size_t to) {
+            return static_cast<int>(std::ceil(Distance(locations[from], locations[to]) * road_factor(generator)));
+        };
+        for (size_t stop = 0; stop < stop_count; ++stop) {
+            StopRequest request{StopName(stop), locations[stop], {}};
+            for (int i = 0; i < 3; ++i) {
+                const auto another = stop_distribution(generator);
+                request.distances.emplace_back(StopName(another), road_distance(stop, another));
+            }
+            requests.stops.push_back(std::move(request));
+            requests.stop_names.push_back(StopName(stop));
+        }
+
+        const auto make_bus = [&](std::string name) {
+            BusRequest bus{std::move(name), {}, coin(generator)};
+            for (size_t i = stops_per_bus(generator); i > 0; --i) {
+                bus.stops.push_back(StopName(stop_distribution(generator)));
+            }
+            if (bus.is_roundtrip) bus.stops.push_back(bus.stops.front());
+            return bus;
+        };
+        for (size_t bus = 0; bus < stop_count / 3; ++bus) {
+            requests.buses.push_back(make_bus("Bus " + std::to_string(bus)));
+        }
+
+        // these build routes again, so they go before the buses that are only applied to what is built.
+        // A stop only a new bus names, and that stop given a location later
+        requests.added.emplace_back(BusRequest{"Unlocated", {StopName(0), "Nowhere", StopName(1)}, false});
+        // a new stop no route names, then a bus through it
+        StopRequest new_stop{"New stop", {latitude(generator), longitude(generator)}, {{StopName(2), 1000}}};
+        requests.added.emplace_back(new_stop);
+        requests.added.emplace_back(BusRequest{"Via new stop", {StopName(2), "New stop", StopName(3)}, false});
+        requests.added.emplace_back(make_bus("After new stop"));
+        requests.added.emplace_back(StopRequest{"Nowhere", {latitude(generator), longitude(generator)}, {}});
+        requests.added.emplace_back(make_bus("After Nowhere"));
+        requests.stop_names.insert(requests.stop_names.end(), {"New stop", "Nowhere", "Unknown"});
+
+        std::uniform_int_distribution<size_t> bus_distribution(0, requests.buses.size() - 1);
+        for (size_t bus = 0; bus < added_count; ++bus) {
+            if (bus % 3 == 0) {
+                auto copy = requests.buses[bus_distribution(generator)];
+                copy.name = (coin(generator) ? "A copy " : "Z copy ") + std::to_string(bus);
+                requests.added.emplace_back(std::move(copy));
+            } else {
+                requests.added.emplace_back(make_bus("New bus " + std::to_string(bus)));
+            }
+        }
+
+        return requests;
+    }
+
+    void Add(DataBase& db, const StopRequest& request) {
+        db.AddStop(request.name, request.location, request.distances);
+    }
+
+    void Add(DataBase& db, const BusRequest& request) {
+        db.AddBus(request.name, Route::ParseRoute(request.stops, request.is_roundtrip));
+    }
+
+    void AddVariant(DataBase& db, const std::variant<StopRequest, BusRequest>& request) {
+        std::visit([&db](const auto& request) { Add(db, request); }, request);
+    }
+
+    Json::Object MakeSettings(std::string_view mode) {
+        Json::Object routing_settings;
+        routing_settings.emplace("bus_wait_time", 6);
+        routing_settings.emplace("bus_velocity", 40);
+        routing_settings.emplace("router_mode", mode);
+        Json::Object settings;
+        settings.emplace("routing_settings", std::move(routing_settings));
+        return settings;
+    }
+
+    bool Close(double lhs, double rhs) {
+        return std::abs(lhs - rhs) <= 1e-9 * std::max({1.0, std::abs(lhs), std::abs(rhs)});
+    }
+
+    std::optional<RouteStats> BusStats(const DataBase& db, std::string_view bus) {
+        try {
+            return db.GetBusStats(bus);
+        } catch (const std::out_of_range&) {
+            // a route with a stop that has no location
+            return std::nullopt;
+        }
+    }
+
+    // stops the route waits at and the number of spans ridden from each
+    std::vector<std::pair<std::string_view, int>> TransferStops(const DataBase::StopsRoute& items) {
+        std::vector<std::pair<std::string_view, int>> stops;
+        for (const auto& [type, time, name, span_count]: items) {
+            if (type == DataBase::RouteItemType::WAIT) stops.emplace_back(name, 0);
+            else if (!stops.empty()) stops.back().second += span_count;
+        }
+        return stops;
+    }
+
+    double TotalTime(const DataBase::StopsRoute& items) {
+        double total = 0;
+        for (const auto& [type, time, name, span_count]: items) total += time;
+        return total;
+    }
+
+    bool SameAnswers(const DataBase& left, const DataBase& right, const Requests& requests, std::mt19937& generator) {
+        std::vector<std::string> bus_names;
+        for (const auto& bus: requests.buses) bus_names.push_back(bus.name);
+        for (const auto& request: requests.added) {
+            if (const auto* bus = std::get_if<BusRequest>(&request)) bus_names.push_back(bus->name);
+        }
+        for (const auto& bus: bus_names) {
+            const auto left_stats = BusStats(left, bus), right_stats = BusStats(right, bus);
+            if (left_stats.has_value() != right_stats.has_value()) return false;
+            if (left_stats && (!Close(left_stats->length, right_stats->length)
+                               || !Close(left_stats->curvature, right_stats->curvature)
+                               || left_stats->stop_count != right_stats->stop_count
+                               || left_stats->unique_stop_count != right_stats->unique_stop_count)) {
+                return false;
+            }
+        }
+
+        for (const auto& stop: requests.stop_names) {
+            if (left.GetStopBuses(stop) != right.GetStopBuses(stop)) return false;
+        }
+
+        // neighbours on routes, where buses that copy others tie with them, and random pairs
+        std::vector<std::pair<std::string, std::string>> pairs;
+        const auto add_neighbours = [&pairs](const BusRequest& bus) {
+            for (size_t i = 1; i < bus.stops.size(); ++i) pairs.emplace_back(bus.stops[i - 1], bus.stops[i]);
+        };
+        for (const auto& bus: requests.buses) add_neighbours(bus);
+        for (const auto& request: requests.added) {
+            if (const auto* bus = std::get_if<BusRequest>(&request)) add_neighbours(*bus);
+        }
+        std::uniform_int_distribution<size_t> stop_distribution(0, requests.stop_names.size() - 1);
+        for (int i = 0; i < 3000; ++i) {
+            pairs.emplace_back(requests.stop_names[stop_distribution(generator)],
+                               requests.stop_names[stop_distribution(generator)]);
+        }
+
+        for (const auto& [from, to]: pairs) {
+            const auto [left_time, left_items, left_map] = left.GetRoute(from, to);
+            const auto [right_time, right_items, right_map] = right.GetRoute(from, to);
+            if (!Close(left_time, right_time)) return false;
+            // paths through other stops that take as long are found depending on the order
+            // edges are added in, they are only checked to add up
+            if (TransferStops(left_items) != TransferStops(right_items)) {
+                if (!Close(TotalTime(left_items), left_time) || !Close(TotalTime(right_items), right_time)) return false;
+                continue;
+            }
+            for (size_t item = 0; item < left_items.size(); ++item) {
+                const auto& [left_type, left_item_time, left_name, left_span_count] = left_items[item];
+                const auto& [right_type, right_item_time, right_name, right_span_count] = right_items[item];
+                if (left_type != right_type || !Close(left_item_time, right_item_time) || left_name != right_name
+                    || left_span_count != right_span_count) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+// Adds buses and stops after routes are built and checks that every answer is the one
+// a database built with all of them at once gives, in each router mode.
+// usage: update_bench [stop_count] [added_count]
+int main(int argc, char** argv) {
+    const size_t stop_count = argc > 1 ? std::atoi(argv[1]) : 300;
+    const size_t added_count = argc > 2 ? std::atoi(argv[2]) : 30;
+    std::mt19937 generator(42);
+    const auto requests = MakeRequests(stop_count, added_count, generator);
+
+    bool all_same = true;
+    std::cout << "mode\tbuild ms\tadded ms per request\tsame answers" << std::endl;
+    for (const std::string_view mode: {"all_pairs", "on_demand", "contraction_hierarchy", "a_star"}) {
+        const auto settings = MakeSettings(mode);
+
+        DataBase updated;
+        updated.SetRouteSettings(settings);
+        for (const auto& stop: requests.stops) Add(updated, stop);
+        for (const auto& bus: requests.buses) Add(updated, bus);
+        const double build_ms = MeasureMs([&] { updated.BuildRoutes(); });
+        const double added_ms = MeasureMs([&] {
+            for (const auto& request: requests.added) AddVariant(updated, request);
+        });
+
+        DataBase rebuilt;
+        rebuilt.SetRouteSettings(settings);
+        for (const auto& stop: requests.stops) Add(rebuilt, stop);
+        for (const auto& bus: requests.buses) Add(rebuilt, bus);
+        for (const auto& request: requests.added) AddVariant(rebuilt, request);
+        rebuilt.BuildRoutes();
+
+        const bool same = SameAnswers(updated, rebuilt, requests, generator);
+        all_same &= same;
+        std::cout << mode << '\t' << build_ms << '\t' << added_ms / requests.added.size()
+                  << '\t' << (same ? "yes" : "NO") << std::endl;
+    }
+
+    return all_same ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <ostream>
+#include <string_view>
+
+#include "database.h"
+#include "json.h"
+
+// Binary image of base requests with the settings that come with them, loaded without parsing text.
+// A header is followed by two sections, the settings and the base: stop and bus names in string
+// tables, stop locations, road distances and bus routes, which refer to names by their ids.
+// Sections, tables and strings are prefixed by their lengths. Numbers are in the byte order of
+// the machine that wrote the file, which is meant to be memory-mapped where it was made.
+namespace BaseFile {
+
+// settings are the members of the input besides the requests
+void Write(std::ostream& output, const busdb::DataBase& db, const Json::Object& settings);
+
+// fills an empty database, strings of the returned settings are views into image;
+// throws std::runtime_error if image is not a base file of this version
+Json::Object Read(std::string_view image, busdb::DataBase& db);
+
+}
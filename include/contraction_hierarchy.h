@@ -0,0 +1,702 @@
+#pragma once
+
+#include "graph.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Contraction hierarchy over a FrozenGraph: vertices are contracted one by one, every contracted
+  // vertex keeps its arcs to the vertices contracted after it, shortcuts replace the routes
+  // going through it. A route is then found by two searches going only up the hierarchy.
+  // Shortcuts remember the two arcs they replace, so routes are unpacked into the original edges.
+  template <typename Weight>
+  class ContractionHierarchy {
+  public:
+    using Index = uint32_t;
+
+  private:
+    static constexpr Index NO_ARC = std::numeric_limits<Index>::max();
+    static constexpr uint64_t FORMAT_TAG = 0x3148435f42445355;  // "USDB_CH1"
+
+    // Arc of the search graphs, kept at its lower ranked end
+    struct SearchArc {
+      Weight weight;
+      Index to;
+      Index arc;
+    };
+
+    // Original arc: first is the edge id, second is NO_ARC. Shortcut: the two arcs it is made of.
+    struct ArcChildren {
+      Index first;
+      Index second;
+    };
+
+  public:
+    // Preprocessing, vertices of every round are contracted in parallel
+    explicit ContractionHierarchy(const FrozenGraph<Weight>& graph);
+
+    // Binary format in native byte order, bound to the graph it was built from
+    void Save(std::ostream& output) const;
+    // nullptr when the input doesn't hold a hierarchy of this very graph
+    static std::unique_ptr<ContractionHierarchy> Load(std::istream& input, const FrozenGraph<Weight>& graph);
+
+    size_t GetVertexCount() const;
+
+    // Buffers of a bidirectional search, reused between routes
+    class Query {
+    public:
+      explicit Query(const ContractionHierarchy& hierarchy);
+
+      // Writes edges of the best route in travel order, false if `to` can't be reached
+      bool Run(VertexId from, VertexId to, std::vector<EdgeId>& edges);
+
+    private:
+      using Generation = uint32_t;
+
+      struct Side {
+        explicit Side(size_t vertex_count);
+
+        std::vector<Generation> reached;
+        std::vector<Generation> settled;
+        std::vector<Weight> weights;
+        std::vector<Index> parents;
+        std::vector<Index> parent_arcs;
+        std::vector<std::pair<Weight, Index>> heap;
+      };
+
+      const ContractionHierarchy& hierarchy_;
+      Generation generation_ = 0;
+      Side forward_;
+      Side backward_;
+      std::vector<Index> forward_arcs_;
+      std::vector<Index> unpack_stack_;
+
+      void StartGeneration();
+      void Relax(Side& side, Index vertex, Weight weight, Index parent, Index parent_arc);
+      void Settle(Side& side, const Side& other, const std::vector<Index>& offsets,
+                  const std::vector<SearchArc>& arcs,
+                  Weight& best_weight, Index& meeting_vertex);
+      void Unpack(Index arc, std::vector<EdgeId>& edges);
+    };
+
+  private:
+    class Builder;
+
+    ContractionHierarchy() = default;
+
+    static uint64_t Fingerprint(const FrozenGraph<Weight>& graph);
+    // offsets and indices of a loaded hierarchy stay within its arrays and the graph
+    bool IsConsistent(const FrozenGraph<Weight>& graph) const;
+
+    size_t vertex_count_ = 0;
+    uint64_t fingerprint_ = 0;
+    std::vector<ArcChildren> arcs_;
+    // arcs to higher ranked vertices, forward search
+    std::vector<Index> up_offsets_;
+    std::vector<SearchArc> up_arcs_;
+    // arcs from higher ranked vertices reversed, backward search
+    std::vector<Index> down_offsets_;
+    std::vector<SearchArc> down_arcs_;
+  };
+
+
+  template <typename Weight>
+  class ContractionHierarchy<Weight>::Builder {
+  public:
+    Builder(const FrozenGraph<Weight>& graph, ContractionHierarchy& hierarchy);
+
+    void Run();
+
+  private:
+    static constexpr size_t WITNESS_SETTLE_LIMIT = 500;
+    static constexpr size_t PRIORITY_SETTLE_LIMIT = 20;
+    static constexpr Weight INF = std::numeric_limits<Weight>::has_infinity
+                                  ? std::numeric_limits<Weight>::infinity() : std::numeric_limits<Weight>::max();
+
+    struct Arc {
+      Index other;
+      Weight weight;
+      Index id;
+    };
+
+    struct Shortcut {
+      Index from;
+      Index to;
+      Weight weight;
+      ArcChildren children;
+    };
+
+    // Bounded Dijkstra looking for routes that make a shortcut needless
+    class WitnessSearch {
+    public:
+      explicit WitnessSearch(size_t vertex_count);
+
+      template <typename Excluded>
+      void Run(const std::vector<std::vector<Arc>>& out_arcs, Index from, Weight max_weight, size_t settle_limit,
+               Excluded excluded);
+      Weight GetWeight(Index vertex) const;
+
+    private:
+      uint32_t generation_ = 0;
+      std::vector<uint32_t> reached_;
+      std::vector<Weight> weights_;
+      std::vector<std::pair<Weight, Index>> heap_;
+    };
+
+    ContractionHierarchy& hierarchy_;
+    const size_t vertex_count_;
+
+    // arcs between not yet contracted vertices
+    std::vector<std::vector<Arc>> out_arcs_;
+    std::vector<std::vector<Arc>> in_arcs_;
+
+    std::vector<uint8_t> contracting_;
+    std::vector<int> deleted_neighbors_;
+    std::vector<int> priorities_;
+    std::vector<uint8_t> dirty_;
+
+    std::vector<std::vector<Arc>> up_lists_;
+    std::vector<std::vector<Arc>> down_lists_;
+
+    void AddArc(Index from, Index to, Weight weight, ArcChildren children);
+
+    template <typename Excluded>
+    void FindShortcuts(Index vertex, WitnessSearch& search, size_t settle_limit, Excluded excluded,
+                       std::vector<Shortcut>& shortcuts) const;
+
+    void UpdatePriorities(const std::vector<Index>& vertices);
+    bool IsLocalMinimum(Index vertex) const;
+    void Contract(Index vertex);
+    void Pack();
+  };
+
+
+  template <typename Weight>
+  ContractionHierarchy<Weight>::Builder::WitnessSearch::WitnessSearch(size_t vertex_count)
+      : reached_(vertex_count, 0),
+        weights_(vertex_count)
+  {
+  }
+
+  template <typename Weight>
+  template <typename Excluded>
+  void ContractionHierarchy<Weight>::Builder::WitnessSearch::Run(const std::vector<std::vector<Arc>>& out_arcs,
+                                                                 Index from, Weight max_weight, size_t settle_limit,
+                                                                 Excluded excluded) {
+    if (++generation_ == 0) {
+      std::fill(std::begin(reached_), std::end(reached_), 0);
+      generation_ = 1;
+    }
+    heap_.clear();
+
+    reached_[from] = generation_;
+    weights_[from] = 0;
+    heap_.emplace_back(0, from);
+
+    for (size_t settled_count = 0; !heap_.empty() && settled_count < settle_limit; ++settled_count) {
+      std::pop_heap(std::begin(heap_), std::end(heap_), std::greater<>());
+      const auto [weight, vertex] = heap_.back();
+      heap_.pop_back();
+      if (weight > weights_[vertex]) continue;
+      if (weight > max_weight) break;
+
+      for (const auto& arc : out_arcs[vertex]) {
+        if (excluded(arc.other)) continue;
+        const Weight candidate_weight = weight + arc.weight;
+        if (reached_[arc.other] != generation_ || candidate_weight < weights_[arc.other]) {
+          reached_[arc.other] = generation_;
+          weights_[arc.other] = candidate_weight;
+          heap_.emplace_back(candidate_weight, arc.other);
+          std::push_heap(std::begin(heap_), std::end(heap_), std::greater<>());
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  Weight ContractionHierarchy<Weight>::Builder::WitnessSearch::GetWeight(Index vertex) const {
+    // tentative weights are still weights of existing routes, good enough for a witness
+    return reached_[vertex] == generation_ ? weights_[vertex] : INF;
+  }
+
+  template <typename Weight>
+  ContractionHierarchy<Weight>::Builder::Builder(const FrozenGraph<Weight>& graph, ContractionHierarchy& hierarchy)
+      : hierarchy_(hierarchy),
+        vertex_count_(graph.GetVertexCount()),
+        out_arcs_(vertex_count_),
+        in_arcs_(vertex_count_),
+        contracting_(vertex_count_, 0),
+        deleted_neighbors_(vertex_count_, 0),
+        priorities_(vertex_count_, 0),
+        dirty_(vertex_count_, 1),
+        up_lists_(vertex_count_),
+        down_lists_(vertex_count_)
+  {
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+      for (const auto& edge : graph.GetIncidentEdges(vertex)) {
+        assert(edge.weight >= 0);
+        if (edge.to != vertex) {
+          AddArc(static_cast<Index>(vertex), static_cast<Index>(edge.to), edge.weight,
+                 {static_cast<Index>(edge.id), NO_ARC});
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Builder::AddArc(Index from, Index to, Weight weight, ArcChildren children) {
+    auto& out_arcs = out_arcs_[from];
+    auto out_it = std::find_if(std::begin(out_arcs), std::end(out_arcs),
+                               [to](const Arc& arc) { return arc.other == to; });
+    if (out_it != std::end(out_arcs) && out_it->weight <= weight) {
+      return;
+    }
+
+    const auto arc_id = static_cast<Index>(hierarchy_.arcs_.size());
+    hierarchy_.arcs_.push_back(children);
+    if (out_it == std::end(out_arcs)) {
+      out_arcs.push_back({to, weight, arc_id});
+      in_arcs_[to].push_back({from, weight, arc_id});
+      return;
+    }
+
+    *out_it = {to, weight, arc_id};
+    auto& in_arcs = in_arcs_[to];
+    *std::find_if(std::begin(in_arcs), std::end(in_arcs),
+                  [from](const Arc& arc) { return arc.other == from; }) = {from, weight, arc_id};
+  }
+
+  template <typename Weight>
+  template <typename Excluded>
+  void ContractionHierarchy<Weight>::Builder::FindShortcuts(Index vertex, WitnessSearch& search, size_t settle_limit,
+                                                            Excluded excluded, std::vector<Shortcut>& shortcuts) const {
+    for (const auto& in_arc : in_arcs_[vertex]) {
+      Weight max_weight = -1;
+      for (const auto& out_arc : out_arcs_[vertex]) {
+        if (out_arc.other != in_arc.other) {
+          max_weight = std::max(max_weight, in_arc.weight + out_arc.weight);
+        }
+      }
+      if (max_weight < 0) continue;
+
+      search.Run(out_arcs_, in_arc.other, max_weight, settle_limit,
+                 [vertex, &excluded](Index other) { return other == vertex || excluded(other); });
+
+      for (const auto& out_arc : out_arcs_[vertex]) {
+        if (out_arc.other == in_arc.other) continue;
+
+        const Weight weight = in_arc.weight + out_arc.weight;
+        if (search.GetWeight(out_arc.other) > weight) {
+          shortcuts.push_back({in_arc.other, out_arc.other, weight, {in_arc.id, out_arc.id}});
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Builder::UpdatePriorities(const std::vector<Index>& vertices) {
+    Parallel::ForChunks(0, vertices.size(), [this, &vertices](size_t begin, size_t end) {
+      WitnessSearch search(vertex_count_);
+      std::vector<Shortcut> shortcuts;
+      for (size_t idx = begin; idx < end; ++idx) {
+        const Index vertex = vertices[idx];
+        if (!dirty_[vertex]) continue;
+
+        shortcuts.clear();
+        // a rough estimate is enough here, extra shortcuts only lower the priority a bit
+        FindShortcuts(vertex, search, PRIORITY_SETTLE_LIMIT, [](Index) { return false; }, shortcuts);
+        // edge difference plus a penalty spreading contraction evenly over the graph
+        priorities_[vertex] = static_cast<int>(shortcuts.size())
+                              - static_cast<int>(in_arcs_[vertex].size() + out_arcs_[vertex].size())
+                              + deleted_neighbors_[vertex];
+      }
+    });
+
+    for (const Index vertex : vertices) {
+      dirty_[vertex] = 0;
+    }
+  }
+
+  template <typename Weight>
+  bool ContractionHierarchy<Weight>::Builder::IsLocalMinimum(Index vertex) const {
+    const auto key = std::make_pair(priorities_[vertex], vertex);
+    const auto is_lower = [this, &key](const Arc& arc) {
+      return std::make_pair(priorities_[arc.other], arc.other) < key;
+    };
+    return std::none_of(std::begin(in_arcs_[vertex]), std::end(in_arcs_[vertex]), is_lower)
+           && std::none_of(std::begin(out_arcs_[vertex]), std::end(out_arcs_[vertex]), is_lower);
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Builder::Contract(Index vertex) {
+    up_lists_[vertex] = std::move(out_arcs_[vertex]);
+    down_lists_[vertex] = std::move(in_arcs_[vertex]);
+
+    for (const auto& arc : up_lists_[vertex]) {
+      auto& arcs = in_arcs_[arc.other];
+      arcs.erase(std::remove_if(std::begin(arcs), std::end(arcs),
+                                [vertex](const Arc& item) { return item.other == vertex; }), std::end(arcs));
+      ++deleted_neighbors_[arc.other];
+      ++priorities_[arc.other];
+      dirty_[arc.other] = 1;
+    }
+
+    for (const auto& arc : down_lists_[vertex]) {
+      auto& arcs = out_arcs_[arc.other];
+      arcs.erase(std::remove_if(std::begin(arcs), std::end(arcs),
+                                [vertex](const Arc& item) { return item.other == vertex; }), std::end(arcs));
+      ++deleted_neighbors_[arc.other];
+      ++priorities_[arc.other];
+      dirty_[arc.other] = 1;
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Builder::Run() {
+    std::vector<Index> remaining(vertex_count_);
+    for (Index vertex = 0; vertex < vertex_count_; ++vertex) {
+      remaining[vertex] = vertex;
+    }
+
+    UpdatePriorities(remaining);
+
+    std::vector<Index> candidates, selected, rest;
+    std::vector<std::vector<Shortcut>> shortcuts;
+    while (!remaining.empty()) {
+      // Priorities are updated lazily: a contraction only bumps the neighbours' priorities,
+      // they are simulated again when the neighbour looks like a local minimum.
+      candidates.clear();
+      std::copy_if(std::begin(remaining), std::end(remaining), std::back_inserter(candidates),
+                   [this](Index vertex) { return IsLocalMinimum(vertex); });
+      UpdatePriorities(candidates);
+
+      // Vertices with the lowest priority among their neighbours are never adjacent,
+      // so they are contracted at once. Witness routes avoid all of them: such a route
+      // has to stay in the graph after the whole round.
+      selected.clear();
+      rest.clear();
+      for (const Index vertex : remaining) {
+        (IsLocalMinimum(vertex) ? selected : rest).push_back(vertex);
+      }
+      for (const Index vertex : selected) {
+        contracting_[vertex] = 1;
+      }
+
+      shortcuts.assign(selected.size(), {});
+      Parallel::ForChunks(0, selected.size(), [this, &selected, &shortcuts](size_t begin, size_t end) {
+        WitnessSearch search(vertex_count_);
+        for (size_t idx = begin; idx < end; ++idx) {
+          FindShortcuts(selected[idx], search, WITNESS_SETTLE_LIMIT, [this](Index other) { return contracting_[other] != 0; },
+                        shortcuts[idx]);
+        }
+      });
+
+      for (const Index vertex : selected) {
+        Contract(vertex);
+      }
+      for (const auto& vertex_shortcuts : shortcuts) {
+        for (const auto& shortcut : vertex_shortcuts) {
+          AddArc(shortcut.from, shortcut.to, shortcut.weight, shortcut.children);
+        }
+      }
+
+      std::swap(remaining, rest);
+    }
+
+    Pack();
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Builder::Pack() {
+    const auto pack = [this](const std::vector<std::vector<Arc>>& lists,
+                             std::vector<Index>& offsets, std::vector<SearchArc>& arcs) {
+      offsets.assign(1, 0);
+      offsets.reserve(vertex_count_ + 1);
+      for (const auto& list : lists) {
+        for (const auto& arc : list) {
+          arcs.push_back({arc.weight, arc.other, arc.id});
+        }
+        offsets.push_back(static_cast<Index>(arcs.size()));
+      }
+    };
+
+    pack(up_lists_, hierarchy_.up_offsets_, hierarchy_.up_arcs_);
+    pack(down_lists_, hierarchy_.down_offsets_, hierarchy_.down_arcs_);
+  }
+
+
+  template <typename Weight>
+  ContractionHierarchy<Weight>::ContractionHierarchy(const FrozenGraph<Weight>& graph)
+      : vertex_count_(graph.GetVertexCount()),
+        fingerprint_(Fingerprint(graph))
+  {
+    Builder(graph, *this).Run();
+  }
+
+  template <typename Weight>
+  size_t ContractionHierarchy<Weight>::GetVertexCount() const {
+    return vertex_count_;
+  }
+
+  template <typename Weight>
+  uint64_t ContractionHierarchy<Weight>::Fingerprint(const FrozenGraph<Weight>& graph) {
+    // FNV-1a over the edge list
+    uint64_t hash = 14695981039346656037ull;
+    const auto add = [&hash](const auto& value) {
+      unsigned char bytes[sizeof(value)];
+      std::memcpy(bytes, &value, sizeof(value));
+      for (const unsigned char byte : bytes) {
+        hash = (hash ^ byte) * 1099511628211ull;
+      }
+    };
+
+    add(static_cast<uint64_t>(graph.GetVertexCount()));
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+      const auto edge = graph.GetEdge(edge_id);
+      add(static_cast<uint64_t>(edge.from));
+      add(static_cast<uint64_t>(edge.to));
+      add(edge.weight);
+    }
+    return hash;
+  }
+
+  namespace Detail {
+    template <typename T>
+    void WritePod(std::ostream& output, const T& value) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      output.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    void WriteVector(std::ostream& output, const std::vector<T>& values) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      WritePod(output, static_cast<uint64_t>(values.size()));
+      output.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    template <typename T>
+    bool ReadPod(std::istream& input, T& value) {
+      return static_cast<bool>(input.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+    // Grows the vector as the data comes in, a size beyond the end of a damaged file
+    // allocates at most a chunk more than the file holds
+    template <typename T>
+    bool ReadVector(std::istream& input, std::vector<T>& values, uint64_t max_size) {
+      constexpr uint64_t CHUNK_SIZE = ((uint64_t(1) << 20) + sizeof(T) - 1) / sizeof(T);
+      uint64_t size = 0;
+      if (!ReadPod(input, size) || size > max_size) return false;
+      values.clear();
+      while (values.size() < size) {
+        const auto begin = values.size();
+        const auto count = std::min(size - begin, CHUNK_SIZE);
+        values.resize(begin + count);
+        if (!input.read(reinterpret_cast<char*>(values.data() + begin), count * sizeof(T))) return false;
+      }
+      return true;
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Save(std::ostream& output) const {
+    Detail::WritePod(output, FORMAT_TAG);
+    Detail::WritePod(output, static_cast<uint64_t>(sizeof(Weight)));
+    Detail::WritePod(output, static_cast<uint64_t>(vertex_count_));
+    Detail::WritePod(output, fingerprint_);
+    Detail::WriteVector(output, arcs_);
+    Detail::WriteVector(output, up_offsets_);
+    Detail::WriteVector(output, up_arcs_);
+    Detail::WriteVector(output, down_offsets_);
+    Detail::WriteVector(output, down_arcs_);
+  }
+
+  template <typename Weight>
+  std::unique_ptr<ContractionHierarchy<Weight>> ContractionHierarchy<Weight>::Load(std::istream& input,
+                                                                                   const FrozenGraph<Weight>& graph) {
+    uint64_t tag = 0, weight_size = 0, vertex_count = 0;
+    std::unique_ptr<ContractionHierarchy> hierarchy(new ContractionHierarchy());
+    if (!Detail::ReadPod(input, tag) || tag != FORMAT_TAG
+        || !Detail::ReadPod(input, weight_size) || weight_size != sizeof(Weight)
+        || !Detail::ReadPod(input, vertex_count) || vertex_count != graph.GetVertexCount()
+        || !Detail::ReadPod(input, hierarchy->fingerprint_) || hierarchy->fingerprint_ != Fingerprint(graph)) {
+      return nullptr;
+    }
+    hierarchy->vertex_count_ = vertex_count;
+
+    const uint64_t max_size = std::numeric_limits<Index>::max();
+    if (!Detail::ReadVector(input, hierarchy->arcs_, max_size)
+        || !Detail::ReadVector(input, hierarchy->up_offsets_, vertex_count + 1)
+        || !Detail::ReadVector(input, hierarchy->up_arcs_, max_size)
+        || !Detail::ReadVector(input, hierarchy->down_offsets_, vertex_count + 1)
+        || !Detail::ReadVector(input, hierarchy->down_arcs_, max_size)
+        || !hierarchy->IsConsistent(graph)) {
+      return nullptr;
+    }
+
+    return hierarchy;
+  }
+
+  template <typename Weight>
+  bool ContractionHierarchy<Weight>::IsConsistent(const FrozenGraph<Weight>& graph) const {
+    // searches index vertices and arcs by what they read, nothing may point out of the arrays
+    const auto valid_search = [this](const std::vector<Index>& offsets, const std::vector<SearchArc>& arcs) {
+      return offsets.size() == vertex_count_ + 1 && offsets.front() == 0 && offsets.back() == arcs.size()
+             && std::is_sorted(std::begin(offsets), std::end(offsets))
+             && std::all_of(std::begin(arcs), std::end(arcs), [this](const SearchArc& arc) {
+               // NaN breaks the order of the search heaps
+               return arc.to < vertex_count_ && arc.arc < arcs_.size() && arc.weight >= 0;
+             });
+    };
+    if (!valid_search(up_offsets_, up_arcs_) || !valid_search(down_offsets_, down_arcs_)) return false;
+
+    // a shortcut is added after the arcs it replaces, so unpacking always goes to lower ids and ends
+    for (Index arc = 0; arc < arcs_.size(); ++arc) {
+      const auto& children = arcs_[arc];
+      if (children.second == NO_ARC ? children.first >= graph.GetEdgeCount()
+                                    : children.first >= arc || children.second >= arc) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+
+  template <typename Weight>
+  ContractionHierarchy<Weight>::Query::Side::Side(size_t vertex_count)
+      : reached(vertex_count, 0),
+        settled(vertex_count, 0),
+        weights(vertex_count),
+        parents(vertex_count),
+        parent_arcs(vertex_count)
+  {
+  }
+
+  template <typename Weight>
+  ContractionHierarchy<Weight>::Query::Query(const ContractionHierarchy& hierarchy)
+      : hierarchy_(hierarchy),
+        forward_(hierarchy.GetVertexCount()),
+        backward_(hierarchy.GetVertexCount())
+  {
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Query::StartGeneration() {
+    if (++generation_ == 0) {
+      for (Side* side : {&forward_, &backward_}) {
+        std::fill(std::begin(side->reached), std::end(side->reached), 0);
+        std::fill(std::begin(side->settled), std::end(side->settled), 0);
+      }
+      generation_ = 1;
+    }
+    forward_.heap.clear();
+    backward_.heap.clear();
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Query::Relax(Side& side, Index vertex, Weight weight,
+                                                  Index parent, Index parent_arc) {
+    if (side.reached[vertex] == generation_ && side.weights[vertex] <= weight) {
+      return;
+    }
+    side.reached[vertex] = generation_;
+    side.weights[vertex] = weight;
+    side.parents[vertex] = parent;
+    side.parent_arcs[vertex] = parent_arc;
+    side.heap.emplace_back(weight, vertex);
+    std::push_heap(std::begin(side.heap), std::end(side.heap), std::greater<>());
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Query::Settle(Side& side, const Side& other, const std::vector<Index>& offsets,
+                                                   const std::vector<SearchArc>& arcs,
+                                                   Weight& best_weight, Index& meeting_vertex) {
+    std::pop_heap(std::begin(side.heap), std::end(side.heap), std::greater<>());
+    const auto [weight, vertex] = side.heap.back();
+    side.heap.pop_back();
+    if (side.settled[vertex] == generation_) return;
+    side.settled[vertex] = generation_;
+
+    if (other.reached[vertex] == generation_ && weight + other.weights[vertex] < best_weight) {
+      best_weight = weight + other.weights[vertex];
+      meeting_vertex = vertex;
+    }
+
+    for (Index idx = offsets[vertex]; idx < offsets[vertex + 1]; ++idx) {
+      const auto& arc = arcs[idx];
+      if (side.settled[arc.to] != generation_) {
+        Relax(side, arc.to, weight + arc.weight, vertex, arc.arc);
+      }
+    }
+  }
+
+  template <typename Weight>
+  bool ContractionHierarchy<Weight>::Query::Run(VertexId from, VertexId to, std::vector<EdgeId>& edges) {
+    edges.clear();
+    StartGeneration();
+    Relax(forward_, static_cast<Index>(from), 0, NO_ARC, NO_ARC);
+    Relax(backward_, static_cast<Index>(to), 0, NO_ARC, NO_ARC);
+
+    constexpr Weight INF = std::numeric_limits<Weight>::has_infinity
+                           ? std::numeric_limits<Weight>::infinity() : std::numeric_limits<Weight>::max();
+    Weight best_weight = INF;
+    Index meeting_vertex = NO_ARC;
+    while (!forward_.heap.empty() || !backward_.heap.empty()) {
+      const Weight forward_min = forward_.heap.empty() ? INF : forward_.heap.front().first;
+      const Weight backward_min = backward_.heap.empty() ? INF : backward_.heap.front().first;
+      // neither search can improve the route any more
+      if (std::min(forward_min, backward_min) >= best_weight) break;
+
+      if (forward_min <= backward_min) {
+        Settle(forward_, backward_, hierarchy_.up_offsets_, hierarchy_.up_arcs_, best_weight, meeting_vertex);
+      } else {
+        Settle(backward_, forward_, hierarchy_.down_offsets_, hierarchy_.down_arcs_, best_weight, meeting_vertex);
+      }
+    }
+
+    if (meeting_vertex == NO_ARC) {
+      return false;
+    }
+
+    forward_arcs_.clear();
+    for (Index vertex = meeting_vertex; vertex != from; vertex = forward_.parents[vertex]) {
+      forward_arcs_.push_back(forward_.parent_arcs[vertex]);
+    }
+    for (auto it = std::rbegin(forward_arcs_); it != std::rend(forward_arcs_); ++it) {
+      Unpack(*it, edges);
+    }
+    for (Index vertex = meeting_vertex; vertex != to; vertex = backward_.parents[vertex]) {
+      Unpack(backward_.parent_arcs[vertex], edges);
+    }
+
+    return true;
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Query::Unpack(Index arc, std::vector<EdgeId>& edges) {
+    unpack_stack_.assign(1, arc);
+    while (!unpack_stack_.empty()) {
+      const auto children = hierarchy_.arcs_[unpack_stack_.back()];
+      unpack_stack_.pop_back();
+      if (children.second == NO_ARC) {
+        edges.push_back(children.first);
+      } else {
+        unpack_stack_.push_back(children.second);
+        unpack_stack_.push_back(children.first);
+      }
+    }
+  }
+}
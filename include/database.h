@@ -1,16 +1,21 @@
 #pragma once
 
-#include<set>
+#include<cstdint>
 #include<unordered_map>
 #include<string>
 #include<string_view>
 #include<optional>
+#include<ostream>
 #include<memory>
 #include<tuple>
 #include<list>
 #include<map>
+#include<vector>
 
 #include "common.h"
+#include "geodesic.h"
+#include "name_pool.h"
+#include "route.h"
 #include "graph.h"
 #include "router.h"
 #include "svg.h"
@@ -18,13 +23,15 @@
 
 namespace busdb {
 
-class Route;
-
 class DataBase {
 public:
     struct RouteSettings {
         int bus_wait_time;
         int bus_velocity;
+        Graph::Router<double>::Mode router_mode;
+        Graph::Router<double>::MatrixWeight router_matrix_weight;
+        // contraction hierarchy is loaded from here when it fits the graph, saved otherwise
+        std::optional<std::string> hierarchy_file;
     };
 
     enum class RouteItemType {
@@ -37,28 +44,51 @@ public:
 
     DataBase();
 
-    DistanceType Distance(const std::string& stop1,
-            const std::string& stop2) const;
+    // road distance if a stop request gives one, else the line distance.
+    // Reads only the snapshot laid out by Finalize, safe to call concurrently
+    DistanceType Distance(StopId stop1, StopId stop2) const;
+
+    DistanceType LineDistance(StopId stop1, StopId stop2) const;
 
-    DistanceType LineDistance(const std::string& stop1,
-            const std::string& stop2) const;
+    // sum of the line distances between neighbours, computed in a batch
+    DistanceType LineDistance(const std::vector<StopId>& stops) const;
 
+    // After Finalize a stop no route names yet and a bus only change their own part of the snapshots
+    // read paths use, the rest is copied. A stop that was named before changes lengths of routes,
+    // everything is laid out and built again.
     void AddStop(std::string stop, Point location,
             std::list<std::pair<std::string, int>> distances);
 
     void AddBus(std::string number, std::shared_ptr<Route> route);
 
+    // binary image of the stops and buses added so far, written before routes are built,
+    // see base_file.h
+    void SaveBase(std::ostream& out) const;
+    // fills an empty database from an image of SaveBase
+    void LoadBase(std::string_view image);
+
     std::shared_ptr<Route> GetBusRoute(const std::string& number) const;
 
-    std::optional<std::set<std::string_view>> GetStopBuses(
+    std::optional<RouteStats> GetBusStats(std::string_view number) const;
+
+    // in name order
+    std::optional<std::vector<std::string_view>> GetStopBuses(
             std::string_view stop) const;
 
     std::tuple<double, StopsRoute, Svg::Document>
     GetRoute(const std::string& from, const std::string& to) const;
 
+    // Routes from one stop to each of `to` in the same order, found by one search where the router allows it
+    std::vector<std::tuple<double, StopsRoute, Svg::Document>>
+    GetRoutes(std::string_view from, const std::vector<std::string_view>& to) const;
+
     void SetRouteSettings(const Json::Object& in_data);
     void SetRenderSettings(const Json::Object& in_data);
 
+    // Lays out stops, buses and distances in the arrays read paths use. BuildRoutes starts with it,
+    // stops and buses added afterwards are applied to a copy of them
+    void Finalize();
+
     void BuildRoutes();
 
     Svg::Document BuildMap() const;
@@ -67,23 +97,132 @@ public:
 private:
     class Render;
     std::unique_ptr<Render> render_;
-    std::map<std::string, Point> stops_;
-    std::map<std::string, std::shared_ptr<Route>> buses_;
-    std::unordered_map<std::string_view, std::set<std::string_view>> stop_buses_;
-    mutable std::unordered_map<std::string_view,
-            std::unordered_map<std::string_view, DistanceType>> distance_hash_;
+    NamePool stop_names_;
+    NamePool bus_names_;
+    // by bus id
+    std::vector<std::shared_ptr<Route>> buses_;
+
+    // as stops and buses are added
+    // by stop id, stops only named in routes have no location
+    std::vector<std::optional<Point>> stops_;
+    // buses of stops that are added or named in routes, in the order buses are added
+    std::unordered_map<StopId, std::vector<BusId>> stop_buses_;
+    // by DistanceKey(from, to)
+    std::unordered_map<uint64_t, DistanceType> distance_hash_;
+
+    enum StopFlags : uint8_t {
+        HAS_LOCATION = 1,
+        // added or named in a route, Stop requests find it
+        HAS_BUSES = 2
+    };
+
+    // What read paths use, laid out by Finalize in arrays indexed by ids. Stops and buses added
+    // afterwards produce a new snapshot, queries hold the one they started with
+    struct Compacted {
+        // by stop id
+        std::vector<uint8_t> stop_flags;
+        std::vector<CoordinateType> latitudes;
+        std::vector<CoordinateType> longitudes;
+        // the same points for line distances, stops without a location are at zero
+        GeoPoints geo_points;
+        // buses of stop s are stop_buses[stop_bus_offsets[s], stop_bus_offsets[s + 1]), in name order
+        std::vector<uint32_t> stop_bus_offsets = {0};
+        std::vector<BusId> stop_buses;
+        // distances from stop s are to distance_to[distance_offsets[s], distance_offsets[s + 1]),
+        // sorted by id, and in distances at the same positions. Every pair of neighbours on a route
+        // is there, with the line distance if no road distance is given
+        std::vector<uint32_t> distance_offsets = {0};
+        std::vector<StopId> distance_to;
+        std::vector<DistanceType> distances;
+        // stops with a location, the graph vertices in this order, and all buses, by name
+        std::vector<StopId> stops_by_name;
+        std::vector<BusId> buses_by_name;
+        // by bus id
+        std::vector<std::shared_ptr<Route>> buses;
+        // by bus id, none for a route with a stop that has no location
+        std::vector<std::optional<RouteStats>> bus_stats;
+
+        size_t StopCount() const;
+        bool HasLocation(StopId stop) const;
+        Point Location(StopId stop) const;
+        std::optional<DistanceType> FindDistance(StopId stop1, StopId stop2) const;
+        DistanceType Distance(StopId stop1, StopId stop2) const;
+        DistanceType LineDistance(StopId stop1, StopId stop2) const;
+        DistanceType LineDistance(const std::vector<StopId>& stops) const;
+        RouteStats Stats(const Route& route) const;
+
+        // adds sorted (DistanceKey, distance) pairs, a pair that is there already takes the new distance
+        void InsertDistances(const std::vector<std::pair<uint64_t, DistanceType>>& distances);
+    };
+    // accessed with std::atomic_load/std::atomic_store, the thread that adds stops and buses
+    // reads it directly
+    std::shared_ptr<const Compacted> compacted_;
+    bool finalized_ = false;
 
     std::optional<RouteSettings> route_settings_ = std::nullopt;
 
-    std::unique_ptr<Graph::DirectedWeightedGraph<double>> routes_ = nullptr;
-    std::unique_ptr<Graph::Router<double>> router_ = nullptr;
+    // Everything route queries read. Buses added after BuildRoutes produce a new snapshot,
+    // queries hold the one they started with.
+    struct Routing {
+        // stops and buses the routes are built of
+        std::shared_ptr<const Compacted> compacted;
+        // shared with the snapshots that only change which bus an edge names
+        std::shared_ptr<const Graph::FrozenGraph<double>> graph;
+        std::shared_ptr<const Graph::Router<double>> router;
+
+        std::vector<StopId> vertex2stop;
+        // by stop id, NO_VERTEX for stops without location
+        std::vector<Graph::VertexId> stop_to_vertex;
+
+        std::vector<std::pair<BusId, int>> edge2bus;
 
-    std::vector<std::string_view> vertex2stop_;
-    std::unordered_map<std::string_view, Graph::VertexId> stop_to_vertex_;
+        static constexpr Graph::VertexId NO_VERTEX = -1;
+
+        bool HasVertex(StopId stop) const;
+        Graph::VertexId GetWaitStopVertexId(StopId stop) const;
+    };
+    // accessed with std::atomic_load/std::atomic_store
+    std::shared_ptr<const Routing> routing_;
+
+    struct BusEdge {
+        Graph::VertexId from, to;
+        double time;
+        int span_count;
+        BusId bus;
+    };
+
+    // calls func(stop vertex from, stop vertex to, time, span count) for every pair of stops of the route,
+    // reads only, so routes are handled in parallel
+    template <typename Func>
+    void ForEachBusEdge(const Route& route, const Routing& routing, Func func) const;
+
+    static uint64_t DistanceKey(StopId from, StopId to) {
+        return uint64_t(from) << 32 | to;
+    }
+
+    StopId InternStop(std::string_view stop);
+
+    // appends stops interned after the snapshot was laid out
+    void AddCompactedStops(Compacted& compacted) const;
+    // lays out only what a stop added after Finalize changes, when nothing named it before.
+    // another_ids are the stops it gives distances to
+    void CompactStop(StopId stop, const std::vector<StopId>& another_ids);
+    // lays out only what a bus added after Finalize changes
+    void CompactBus(BusId bus);
+
+    // applies only the edges of a bus added after BuildRoutes
+    void UpdateRoutes(BusId bus, const Route& route);
+
+    std::tuple<double, StopsRoute, Svg::Document>
+    ExpandRoute(const Routing& routing, double weight, const std::vector<Graph::EdgeId>& edges,
+                StopId to, Svg::Document map) const;
 
-    std::vector<std::pair<std::string_view, int>> edge2bus_;
+    std::unique_ptr<Graph::ContractionHierarchy<double>> LoadOrBuildHierarchy(const Graph::FrozenGraph<double>& graph) const;
 
-    Graph::VertexId GetWaitStopVertexId(std::string_view stop) const;
+    // A_STAR mode is only exact when every road is at least as long as the line between its stops
+    bool HasRoadShorterThanLine() const;
+    bool HasRoadShorterThanLine(const Route& route) const;
+    Graph::Router<double>::LowerBound MakeTimeLowerBound() const;
 };
 
 }
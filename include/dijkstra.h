@@ -0,0 +1,214 @@
+#pragma once
+
+#include "graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Single-source shortest paths computed on demand.
+  // All buffers are sized once per graph and reused between searches:
+  // vertices touched by a previous search are recognised by a generation stamp,
+  // so a new search never pays O(V) for resetting its state.
+  template <typename Weight>
+  class Dijkstra {
+  private:
+    using Graph = FrozenGraph<Weight>;
+
+  public:
+    explicit Dijkstra(const Graph& graph);
+
+    // Runs search from `from`. If `to` is given, search stops as soon as `to` is settled.
+    void Run(VertexId from, std::optional<VertexId> to = std::nullopt);
+
+    // A* search from `from` to `to`. lower_bound(vertex) estimates the weight of the route from vertex to `to`
+    // and has to be consistent: never above an edge weight plus the estimate at the edge's end.
+    // Then `to` is settled with the same weight as by the plain search, and vertices far from the way are skipped.
+    template <typename LowerBound>
+    void Run(VertexId from, VertexId to, LowerBound lower_bound);
+
+    // Runs search from `from` until all `targets` are settled or nothing more is reachable
+    void Run(VertexId from, const std::vector<VertexId>& targets);
+
+    bool IsReached(VertexId vertex) const;
+    // a settled vertex has its best weight and path
+    bool IsSettled(VertexId vertex) const;
+    Weight GetWeight(VertexId vertex) const;
+    std::optional<EdgeId> GetPrevEdge(VertexId vertex) const;
+    // number of vertices settled by the last search
+    size_t GetSettledCount() const;
+
+    // Writes edges of the path from the last source to `to` in travel order, `to` has to be reached
+    void GetPath(VertexId to, std::vector<EdgeId>& edges) const;
+
+  private:
+    using Generation = uint32_t;
+    using HeapItem = std::pair<Weight, VertexId>;
+
+    const Graph& graph_;
+
+    Generation generation_ = 0;
+    std::vector<Generation> reached_;
+    std::vector<Generation> settled_;
+    std::vector<Generation> targets_;
+    std::vector<Weight> weights_;
+    std::vector<Weight> lower_bounds_;
+    std::vector<std::optional<EdgeId>> prev_edges_;
+    // ordered by weight plus lower bound
+    std::vector<HeapItem> heap_;
+    size_t settled_count_ = 0;
+
+    void StartGeneration();
+
+    // search of the current generation, stops once is_done(vertex) is true for a settled vertex
+    template <typename LowerBound, typename IsDone>
+    void Search(VertexId from, const LowerBound& lower_bound, const IsDone& is_done);
+
+    template <typename LowerBound>
+    void Relax(VertexId vertex, Weight weight, std::optional<EdgeId> prev_edge, const LowerBound& lower_bound);
+  };
+
+
+  template <typename Weight>
+  Dijkstra<Weight>::Dijkstra(const Graph& graph)
+      : graph_(graph),
+        reached_(graph.GetVertexCount(), 0),
+        settled_(graph.GetVertexCount(), 0),
+        targets_(graph.GetVertexCount(), 0),
+        weights_(graph.GetVertexCount()),
+        lower_bounds_(graph.GetVertexCount()),
+        prev_edges_(graph.GetVertexCount())
+  {
+  }
+
+  template <typename Weight>
+  void Dijkstra<Weight>::StartGeneration() {
+    if (++generation_ == 0) {
+      // stamps wrapped around, old marks could be taken for fresh ones
+      std::fill(std::begin(reached_), std::end(reached_), 0);
+      std::fill(std::begin(settled_), std::end(settled_), 0);
+      std::fill(std::begin(targets_), std::end(targets_), 0);
+      generation_ = 1;
+    }
+    heap_.clear();
+    settled_count_ = 0;
+  }
+
+  template <typename Weight>
+  template <typename LowerBound>
+  void Dijkstra<Weight>::Relax(VertexId vertex, Weight weight, std::optional<EdgeId> prev_edge,
+                               const LowerBound& lower_bound) {
+    if (reached_[vertex] != generation_) {
+      reached_[vertex] = generation_;
+      lower_bounds_[vertex] = lower_bound(vertex);
+    } else if (weights_[vertex] <= weight) {
+      return;
+    }
+    weights_[vertex] = weight;
+    prev_edges_[vertex] = prev_edge;
+    heap_.emplace_back(weight + lower_bounds_[vertex], vertex);
+    std::push_heap(std::begin(heap_), std::end(heap_), std::greater<>());
+  }
+
+  template <typename Weight>
+  void Dijkstra<Weight>::Run(VertexId from, std::optional<VertexId> to) {
+    StartGeneration();
+    Search(from, [](VertexId) { return Weight{}; }, [to](VertexId vertex) { return to && vertex == *to; });
+  }
+
+  template <typename Weight>
+  template <typename LowerBound>
+  void Dijkstra<Weight>::Run(VertexId from, VertexId to, LowerBound lower_bound) {
+    StartGeneration();
+    Search(from, lower_bound, [to](VertexId vertex) { return vertex == to; });
+  }
+
+  template <typename Weight>
+  void Dijkstra<Weight>::Run(VertexId from, const std::vector<VertexId>& targets) {
+    StartGeneration();
+    size_t targets_left = 0;
+    for (const VertexId target : targets) {
+      if (targets_[target] != generation_) {
+        targets_[target] = generation_;
+        ++targets_left;
+      }
+    }
+    if (targets_left == 0) return;
+
+    Search(from, [](VertexId) { return Weight{}; }, [this, &targets_left](VertexId vertex) {
+      return targets_[vertex] == generation_ && --targets_left == 0;
+    });
+  }
+
+  template <typename Weight>
+  template <typename LowerBound, typename IsDone>
+  void Dijkstra<Weight>::Search(VertexId from, const LowerBound& lower_bound, const IsDone& is_done) {
+    Relax(from, 0, std::nullopt, lower_bound);
+
+    while (!heap_.empty()) {
+      std::pop_heap(std::begin(heap_), std::end(heap_), std::greater<>());
+      const VertexId vertex = heap_.back().second;
+      heap_.pop_back();
+
+      // stale heap entry, vertex was already settled with a better weight
+      if (settled_[vertex] == generation_) continue;
+      settled_[vertex] = generation_;
+      ++settled_count_;
+
+      if (is_done(vertex)) break;
+
+      const Weight weight = weights_[vertex];
+      for (const auto& edge : graph_.GetIncidentEdges(vertex)) {
+        assert(edge.weight >= 0);
+        if (settled_[edge.to] != generation_) {
+          Relax(edge.to, weight + edge.weight, edge.id, lower_bound);
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  bool Dijkstra<Weight>::IsReached(VertexId vertex) const {
+    return reached_[vertex] == generation_;
+  }
+
+  template <typename Weight>
+  bool Dijkstra<Weight>::IsSettled(VertexId vertex) const {
+    return settled_[vertex] == generation_;
+  }
+
+  template <typename Weight>
+  Weight Dijkstra<Weight>::GetWeight(VertexId vertex) const {
+    assert(IsReached(vertex));
+    return weights_[vertex];
+  }
+
+  template <typename Weight>
+  std::optional<EdgeId> Dijkstra<Weight>::GetPrevEdge(VertexId vertex) const {
+    assert(IsReached(vertex));
+    return prev_edges_[vertex];
+  }
+
+  template <typename Weight>
+  size_t Dijkstra<Weight>::GetSettledCount() const {
+    return settled_count_;
+  }
+
+  template <typename Weight>
+  void Dijkstra<Weight>::GetPath(VertexId to, std::vector<EdgeId>& edges) const {
+    edges.clear();
+    for (std::optional<EdgeId> edge_id = GetPrevEdge(to);
+         edge_id;
+         edge_id = GetPrevEdge(graph_.GetEdge(*edge_id).from)) {
+      edges.push_back(*edge_id);
+    }
+    std::reverse(std::begin(edges), std::end(edges));
+  }
+}
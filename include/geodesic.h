@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+
+namespace busdb {
+
+// Points with the sines and cosines of their latitudes computed once, for many great-circle
+// distances between them. A distance is exactly what busdb::Distance gives for the same points:
+// the same operations in the same order, only the latitude terms are not computed again.
+class GeoPoints {
+public:
+    void Reserve(size_t count);
+
+    // points are numbered in the order they are added
+    uint32_t Add(Point point);
+
+    size_t Size() const;
+
+    DistanceType Distance(uint32_t from, uint32_t to) const;
+
+    // out[i] is the distance from from[i] to to[i]. Runs a block of pairs at a time: gathers and
+    // products are vectorized, cosines of longitude differences and arccosines are left to libm
+    void Distances(const uint32_t* from, const uint32_t* to, size_t count, DistanceType* out) const;
+
+    // sum of the distances between neighbours, added up in order
+    DistanceType PathDistance(const std::vector<uint32_t>& points) const;
+
+private:
+    std::vector<double> sin_latitudes_;
+    std::vector<double> cos_latitudes_;
+    // in radians
+    std::vector<double> longitudes_;
+};
+
+}
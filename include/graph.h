@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <deque>
+#include <iterator>
+#include <limits>
 #include <vector>
 
 template <typename It>
@@ -83,4 +87,159 @@ namespace Graph {
     const auto& edges = incidence_lists_[vertex];
     return {std::begin(edges), std::end(edges)};
   }
+
+
+  // Immutable compressed sparse row copy of DirectedWeightedGraph.
+  // Outgoing edges of a vertex are contiguous and keep the order they were added in,
+  // their targets, weights and ids are stored in separate arrays with 32-bit ids.
+  template <typename Weight>
+  class FrozenGraph {
+  public:
+    using Index = uint32_t;
+
+    struct IncidentEdge {
+      VertexId to;
+      Weight weight;
+      EdgeId id;
+    };
+
+    class IncidentEdgeIterator {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = IncidentEdge;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = IncidentEdge;
+
+      IncidentEdgeIterator(const FrozenGraph* graph, Index position) : graph_(graph), position_(position) {}
+
+      IncidentEdge operator*() const {
+        return {graph_->targets_[position_], graph_->weights_[position_], graph_->edge_ids_[position_]};
+      }
+      IncidentEdgeIterator& operator++() { ++position_; return *this; }
+      bool operator==(const IncidentEdgeIterator& other) const { return position_ == other.position_; }
+      bool operator!=(const IncidentEdgeIterator& other) const { return position_ != other.position_; }
+
+    private:
+      const FrozenGraph* graph_;
+      Index position_;
+    };
+
+    explicit FrozenGraph(const DirectedWeightedGraph<Weight>& graph);
+    // `graph` with `edges` added after its own ones, the same as adding them to the source graph
+    FrozenGraph(const FrozenGraph& graph, const std::vector<Edge<Weight>>& edges);
+
+    size_t GetVertexCount() const;
+    size_t GetEdgeCount() const;
+    Edge<Weight> GetEdge(EdgeId edge_id) const;
+    Range<IncidentEdgeIterator> GetIncidentEdges(VertexId vertex) const;
+
+  private:
+    // edge attributes by edge id
+    std::vector<Index> edge_from_;
+    std::vector<Index> edge_to_;
+    std::vector<Weight> edge_weights_;
+
+    // adjacency: edges going from vertex v are at [offsets_[v], offsets_[v + 1])
+    std::vector<Index> offsets_;
+    std::vector<Index> targets_;
+    std::vector<Weight> weights_;
+    std::vector<Index> edge_ids_;
+  };
+
+
+  template <typename Weight>
+  FrozenGraph<Weight>::FrozenGraph(const DirectedWeightedGraph<Weight>& graph) {
+    const size_t vertex_count = graph.GetVertexCount(), edge_count = graph.GetEdgeCount();
+    assert(vertex_count < std::numeric_limits<Index>::max() && edge_count < std::numeric_limits<Index>::max());
+
+    edge_from_.reserve(edge_count);
+    edge_to_.reserve(edge_count);
+    edge_weights_.reserve(edge_count);
+    for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+      const auto& edge = graph.GetEdge(edge_id);
+      edge_from_.push_back(static_cast<Index>(edge.from));
+      edge_to_.push_back(static_cast<Index>(edge.to));
+      edge_weights_.push_back(edge.weight);
+    }
+
+    offsets_.reserve(vertex_count + 1);
+    targets_.reserve(edge_count);
+    weights_.reserve(edge_count);
+    edge_ids_.reserve(edge_count);
+    offsets_.push_back(0);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+        targets_.push_back(edge_to_[edge_id]);
+        weights_.push_back(edge_weights_[edge_id]);
+        edge_ids_.push_back(static_cast<Index>(edge_id));
+      }
+      offsets_.push_back(static_cast<Index>(targets_.size()));
+    }
+  }
+
+  template <typename Weight>
+  FrozenGraph<Weight>::FrozenGraph(const FrozenGraph& graph, const std::vector<Edge<Weight>>& edges)
+      : edge_from_(graph.edge_from_),
+        edge_to_(graph.edge_to_),
+        edge_weights_(graph.edge_weights_)
+  {
+    const size_t vertex_count = graph.GetVertexCount(), edge_count = graph.GetEdgeCount() + edges.size();
+    assert(edge_count < std::numeric_limits<Index>::max());
+
+    // new edges go to the end of their vertices' adjacency, existing ones keep their order
+    std::vector<Index> added_counts(vertex_count, 0);
+    for (const auto& edge : edges) {
+      assert(edge.from < vertex_count && edge.to < vertex_count);
+      edge_from_.push_back(static_cast<Index>(edge.from));
+      edge_to_.push_back(static_cast<Index>(edge.to));
+      edge_weights_.push_back(edge.weight);
+      ++added_counts[edge.from];
+    }
+
+    offsets_.reserve(vertex_count + 1);
+    offsets_.push_back(0);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      offsets_.push_back(offsets_.back() + (graph.offsets_[vertex + 1] - graph.offsets_[vertex]) + added_counts[vertex]);
+    }
+
+    targets_.resize(edge_count);
+    weights_.resize(edge_count);
+    edge_ids_.resize(edge_count);
+    std::vector<Index> positions(std::begin(offsets_), std::end(offsets_) - 1);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      for (Index position = graph.offsets_[vertex]; position < graph.offsets_[vertex + 1]; ++position) {
+        targets_[positions[vertex]] = graph.targets_[position];
+        weights_[positions[vertex]] = graph.weights_[position];
+        edge_ids_[positions[vertex]++] = graph.edge_ids_[position];
+      }
+    }
+    for (EdgeId edge_id = graph.GetEdgeCount(); edge_id < edge_count; ++edge_id) {
+      const Index position = positions[edge_from_[edge_id]]++;
+      targets_[position] = edge_to_[edge_id];
+      weights_[position] = edge_weights_[edge_id];
+      edge_ids_[position] = static_cast<Index>(edge_id);
+    }
+  }
+
+  template <typename Weight>
+  size_t FrozenGraph<Weight>::GetVertexCount() const {
+    return offsets_.size() - 1;
+  }
+
+  template <typename Weight>
+  size_t FrozenGraph<Weight>::GetEdgeCount() const {
+    return edge_from_.size();
+  }
+
+  template <typename Weight>
+  Edge<Weight> FrozenGraph<Weight>::GetEdge(EdgeId edge_id) const {
+    return {edge_from_[edge_id], edge_to_[edge_id], edge_weights_[edge_id]};
+  }
+
+  template <typename Weight>
+  Range<typename FrozenGraph<Weight>::IncidentEdgeIterator>
+  FrozenGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+    return {{this, offsets_[vertex]}, {this, offsets_[vertex + 1]}};
+  }
 }
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <istream>
-#include <map>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 #include <unordered_set>
@@ -10,10 +15,39 @@
 
 namespace Json {
 class Node;
-using Object = std::map<std::string, Node>;
-using Array = std::vector<Node>;
+class StructuralIndex;
+using Array = std::pmr::vector<Node>;
 
-class Node: std::variant<Array, Object, int, double, bool, std::string> {
+// Members in one vector sorted by key, the first of equal keys is kept, as std::map used to do
+class Object {
+public:
+    using Member = std::pair<std::pmr::string, Node>;
+    using const_iterator = std::pmr::vector<Member>::const_iterator;
+
+    explicit Object(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    // members in any order
+    explicit Object(std::pmr::vector<Member> members);
+
+    // false if the key is there already
+    bool emplace(std::string_view key, Node value);
+
+    // throws std::out_of_range if there is no such key
+    const Node& at(std::string_view key) const;
+    const_iterator find(std::string_view key) const;
+    size_t count(std::string_view key) const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    std::pmr::vector<Member> members;
+};
+
+// Containers and owned strings take their memory from a memory resource, the arena of a loaded Document.
+// Strings that needed no unescaping are views into the buffer of the Document
+class Node: std::variant<Array, Object, int, double, bool, std::pmr::string, std::string_view> {
 public:
     enum class Type {
         ArrayType = 0,
@@ -21,7 +55,8 @@ public:
         IntType,
         DoubleType,
         BooleanType,
-        StringType
+        StringType,
+        StringViewType
     };
 
     using variant::variant;
@@ -42,13 +77,157 @@ public:
     double AsDouble() const {
         return std::get<double>(*this);
     }
-    const auto& AsString() const {
-        return std::get<std::string>(*this);
+    bool IsString() const {
+        return index() == (size_t)Type::StringType || index() == (size_t)Type::StringViewType;
+    }
+    std::string_view AsString() const {
+        if (index() == (size_t)Type::StringViewType) {
+            return std::get<std::string_view>(*this);
+        }
+        return std::get<std::pmr::string>(*this);
     }
 };
 
 bool operator == (const Node& left, const Node& right);
 
+class ParsingError: public std::runtime_error {
+public:
+    ParsingError(const std::string& what, size_t offset);
+
+    // position of the error from the beginning of the input
+    size_t GetOffset() const;
+
+private:
+    size_t offset;
+};
+
+// Whole input in contiguous memory: a memory-mapped file or a fully read stream.
+// Copies share the same memory, it is released with the last one.
+class Buffer {
+public:
+    static Buffer FromFile(const std::string& path);
+    static Buffer FromStream(std::istream& input);
+
+    std::string_view View() const;
+
+private:
+    Buffer(std::shared_ptr<const char> data, size_t size);
+
+    std::shared_ptr<const char> data;
+    size_t size;
+};
+
+// Pull parser: the caller walks the document value by value, no Nodes are built unless asked for.
+// Strings are views into the input, or into the reader's own storage until the next read if they had escapes.
+class Reader {
+public:
+    // with structural_index whitespace is skipped by the positions of StructuralIndex,
+    // copies of the reader share the index
+    explicit Reader(std::string_view input, bool structural_index = false);
+
+    // BeginObject, then NextKey until it returns false at the closing brace,
+    // every key has to be followed by reading or skipping its value
+    void BeginObject();
+    bool NextKey(std::string_view& key);
+    // BeginArray, then NextItem before every value until it returns false at the closing bracket
+    void BeginArray();
+    bool NextItem();
+
+    std::string_view ReadString();
+    int ReadInt();
+    // int values are accepted too
+    double ReadDouble();
+    bool ReadBoolean();
+    // containers and unescaped strings of the value are allocated from resource
+    Node ReadNode(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    void Skip();
+
+    // Positions [begin, end) of the items of the array at the reader, found by a structural scan
+    // without parsing them, so that they can be read apart. The reader moves past the array
+    std::vector<std::pair<size_t, size_t>> FindArrayItems();
+    // a reader of [from, to) of the same input, reporting offsets from the beginning of the input
+    Reader Slice(size_t from, size_t to) const;
+
+    // checks that only whitespace is left
+    void Finish();
+
+    size_t GetOffset() const;
+
+private:
+    const char* begin;
+    const char* pos;
+    const char* end;
+    // no value has been read since the last opening bracket
+    bool first_item = false;
+    std::string unescaped;
+    std::shared_ptr<StructuralIndex> index;
+    // items of the arrays and objects being read
+    std::vector<Node> item_stack;
+    std::vector<Object::Member> member_stack;
+
+    [[noreturn]] void Fail(const std::string& what) const;
+    const char* SkipSpaces();
+    char NextChar();
+    void Expect(char c);
+    bool NextMember(char close);
+
+    // views into the input when there are no escapes, otherwise into unescaped
+    std::string_view ParseString();
+    void AppendEscaped();
+    uint32_t ParseHex4();
+    Node ParseLiteral();
+};
+
+// FNV-1a, for switching over object keys. Different keys can have the same hash,
+// a case compares the key as well: case KeyHash("name"): if (key != "name") break;
+constexpr uint64_t KeyHash(std::string_view key) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c: key) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Writes JSON in the layout of Save without building Nodes. Save orders object members by key,
+// here they come in the order they are written. Strings are written as they are, as Save does.
+// Text is buffered and passed to the stream in large pieces.
+class Writer {
+public:
+    explicit Writer(std::ostream& output);
+    ~Writer();
+
+    Writer& BeginArray();
+    Writer& EndArray();
+    Writer& BeginObject();
+    Writer& EndObject();
+    Writer& Key(std::string_view key);
+
+    Writer& Int(int value);
+    // with the precision of the stream
+    Writer& Double(double value);
+    Writer& Boolean(bool value);
+    Writer& String(std::string_view value);
+    // a string value rendered by write, quotes and backslashes it prints are escaped
+    // on the way into the output buffer
+    Writer& EscapedString(const std::function<void(std::ostream&)>& write);
+
+    void Flush();
+
+private:
+    class EscapingBuffer;
+
+    std::ostream& output;
+    const int precision;
+    std::string buffer;
+    // per open container: nothing has been written into it yet
+    std::vector<bool> first_items;
+    bool after_key = false;
+
+    void BeginValue();
+    void EndContainer();
+    void AppendEscaped(std::string_view text);
+};
+
 class Document {
 public:
     explicit Document(Node root);
@@ -56,9 +235,19 @@ public:
     const Node& GetRoot() const;
 
 private:
-    Node root;
+    friend Document Load(Buffer buffer);
+
+    // root is in the arena, string views point into the buffer
+    Document(Buffer buffer, std::unique_ptr<std::pmr::monotonic_buffer_resource> arena, const Node* root);
+
+    std::optional<Buffer> buffer;
+    // every node, container and string of a loaded document, released at once without running destructors
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+    const Node* arena_root = nullptr;
+    std::optional<Node> root;
 };
 
+Document Load(Buffer buffer);
 Document Load(std::istream& input);
 
 void Save(const Document& document, std::ostream& output);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace Json {
+
+// First stage of parsing: finds where tokens begin outside of strings, i.e. brackets, braces,
+// colons, commas, opening quotes and first characters of literals. Characters are classified
+// 64 at a time, with AVX2 when the build has it, string interiors are masked out with bit tricks.
+// The input is indexed window by window as positions are asked for, so they stay small and in cache.
+class StructuralIndex {
+public:
+    explicit StructuralIndex(std::string_view input);
+
+    // first token beginning at pos or after it, input size if there is none;
+    // nullopt if pos is before the current window and has to be scanned by the caller
+    std::optional<size_t> NextToken(size_t pos) {
+        while (cursor < positions.size() && positions[cursor] < pos) {
+            ++cursor;
+        }
+        if (cursor < positions.size() && (cursor == 0 ? pos >= window_begin : positions[cursor - 1] < pos)) {
+            return positions[cursor];
+        }
+        return FindNextToken(pos);
+    }
+
+    static bool IsVectorized();
+
+private:
+    std::string_view input;
+    size_t window_begin = 0;
+    size_t window_end = 0;
+    std::vector<size_t> positions;
+    size_t cursor = 0;
+
+    // carried from block to block
+    uint64_t prev_odd_backslash = 0;
+    uint64_t prev_in_string = 0;
+    uint64_t prev_scalar = 0;
+
+    std::optional<size_t> FindNextToken(size_t pos);
+    void IndexWindow();
+    void IndexBlock(const char* block, size_t block_begin);
+};
+}
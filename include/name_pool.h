@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace busdb {
+
+using NameId = uint32_t;
+using StopId = NameId;
+using BusId = NameId;
+
+// Gives every distinct name a dense id, in the order names are first seen.
+// Data is kept by id, names are only compared where requests come in and responses go out.
+// One thread interns names while others find them and read them by id: a name is readable
+// by any thread that got its id after it was interned.
+class NamePool {
+public:
+    NameId Intern(std::string_view name);
+
+    std::optional<NameId> Find(std::string_view name) const;
+
+    // stays valid as long as the pool
+    std::string_view Name(NameId id) const {
+        const auto [block, offset] = Locate(id);
+        return blocks_[block][offset];
+    }
+
+    // for the interning thread
+    size_t Size() const;
+
+    void SortByName(std::vector<NameId>& ids) const;
+
+private:
+    // names by id in blocks that never move, block b holds FIRST_BLOCK_SIZE << b of them
+    static constexpr size_t FIRST_BLOCK_BITS = 6;
+    static constexpr size_t FIRST_BLOCK_SIZE = size_t(1) << FIRST_BLOCK_BITS;
+    static constexpr size_t BLOCK_COUNT = 32 - FIRST_BLOCK_BITS;
+
+    static std::pair<size_t, size_t> Locate(NameId id) {
+        const uint64_t position = uint64_t(id) + FIRST_BLOCK_SIZE;
+        const size_t block = 63 - __builtin_clzll(position) - FIRST_BLOCK_BITS;
+        return {block, position - (FIRST_BLOCK_SIZE << block)};
+    }
+
+    // a deque doesn't move its strings, views of them stay valid
+    std::deque<std::string> storage_;
+    std::array<std::unique_ptr<std::string_view[]>, BLOCK_COUNT> blocks_;
+    size_t size_ = 0;
+
+    // only Intern changes ids_, it locks it exclusively when it does
+    mutable std::shared_mutex ids_mutex_;
+    std::unordered_map<std::string_view, NameId> ids_;
+};
+
+}
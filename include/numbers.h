@@ -0,0 +1,26 @@
+#pragma once
+
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Locale-free conversions between numbers and text, shared by the JSON and the text front ends.
+// Parsing goes through std::from_chars, which is Eisel-Lemire for doubles in current standard libraries.
+namespace Numbers {
+
+// the whole text has to be the number, no leading whitespace or '+'
+std::optional<int> ParseInt(std::string_view text);
+std::optional<double> ParseDouble(std::string_view text);
+
+// Writes value exactly as out << value does with the default float field: printf("%.*g") with the precision
+// of the stream, but through std::to_chars instead of the stream's locale facets
+struct Double {
+    double value;
+};
+
+std::ostream& operator<<(std::ostream& out, Double number);
+
+// appends value as printf("%.*g", precision, value) does
+void AppendDouble(std::string& out, double value, int precision);
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+
+  inline size_t ThreadCount() {
+    static const size_t count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return count;
+  }
+
+  // ThreadCount() - 1 threads started on first use and kept until exit, the thread that runs tasks
+  // is the last one. Calls made from a task of the pool, on any of its threads, and calls from another
+  // thread while the pool is busy run their tasks on the calling thread alone.
+  class ThreadPool {
+  public:
+    static ThreadPool& Instance() {
+      static ThreadPool pool(ThreadCount() - 1);
+      return pool;
+    }
+
+    // Calls task(idx) for every idx in [0, task_count), a thread takes the next idx as soon as it is done
+    // with one. Returns when all are done, rethrows the first exception of a task.
+    void Run(size_t task_count, const std::function<void(size_t)>& task) {
+      // a nested call must not lock run_mutex_ again on the thread that holds it
+      if (in_task_ || workers_.empty() || task_count < 2) {
+        RunInline(task_count, task);
+        return;
+      }
+      std::unique_lock<std::mutex> running(run_mutex_, std::try_to_lock);
+      if (!running) {
+        RunInline(task_count, task);
+        return;
+      }
+
+      // workers that wake up late find no tasks left in the job they hold
+      auto job = std::make_shared<Job>(task, task_count);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = job;
+        ++generation_;
+      }
+      wake_.notify_all();
+
+      RunTasks(*job);
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [&job] { return job->done == job->task_count; });
+      job_.reset();
+      lock.unlock();
+
+      if (job->error) std::rethrow_exception(job->error);
+    }
+
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      for (auto& worker: workers_) {
+        worker.join();
+      }
+    }
+
+  private:
+    struct Job {
+      Job(const std::function<void(size_t)>& task, size_t task_count) : task(task), task_count(task_count) {}
+
+      const std::function<void(size_t)>& task;
+      const size_t task_count;
+      std::atomic<size_t> next = 0;
+      // guarded by the pool mutex
+      size_t done = 0;
+      std::exception_ptr error;
+    };
+
+    explicit ThreadPool(size_t worker_count) {
+      workers_.reserve(worker_count);
+      for (size_t worker = 0; worker < worker_count; ++worker) {
+        workers_.emplace_back([this] { Work(); });
+      }
+    }
+
+    void Work() {
+      uint64_t seen_generation = 0;
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        wake_.wait(lock, [this, &seen_generation] { return stop_ || (job_ && generation_ != seen_generation); });
+        if (stop_) return;
+
+        seen_generation = generation_;
+        const auto job = job_;
+        lock.unlock();
+        RunTasks(*job);
+        lock.lock();
+      }
+    }
+
+    static void RunInline(size_t task_count, const std::function<void(size_t)>& task) {
+      for (size_t idx = 0; idx < task_count; ++idx) {
+        task(idx);
+      }
+    }
+
+    void RunTasks(Job& job) {
+      size_t done = 0;
+      std::exception_ptr error;
+      in_task_ = true;
+      for (size_t idx; (idx = job.next.fetch_add(1)) < job.task_count; ++done) {
+        try {
+          job.task(idx);
+        } catch (...) {
+          if (!error) error = std::current_exception();
+        }
+      }
+      in_task_ = false;
+      if (done == 0) return;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error && !job.error) job.error = error;
+      job.done += done;
+      if (job.done == job.task_count) done_.notify_all();
+    }
+
+    // set while the thread runs tasks of a job, its own calls to Run go inline
+    static inline thread_local bool in_task_ = false;
+
+    std::vector<std::thread> workers_;
+    // held by the call that owns the workers, only tried by threads outside the pool's tasks
+    std::mutex run_mutex_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::shared_ptr<Job> job_;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+  };
+
+  // Splits [begin, end) into one contiguous chunk per thread and calls func(chunk_begin, chunk_end)
+  // for every chunk on the threads of the pool. The calling thread takes part, returns when all chunks are done.
+  template <typename Func>
+  void ForChunks(size_t begin, size_t end, Func func) {
+    if (begin >= end) return;
+
+    const size_t count = end - begin;
+    const size_t threads = std::min(ThreadCount(), count);
+    const size_t chunk = (count + threads - 1) / threads;
+
+    ThreadPool::Instance().Run((count + chunk - 1) / chunk, [begin, end, chunk, &func](size_t idx) {
+      const size_t chunk_begin = begin + idx * chunk;
+      func(chunk_begin, std::min(chunk_begin + chunk, end));
+    });
+  }
+
+  // Calls func(chunk_begin, chunk_end) for chunks of at most chunk items of [begin, end) on all threads.
+  // A thread takes the next chunk as soon as it is done with one, so items that take uneven time
+  // keep every thread busy. The calling thread takes part, returns when all chunks are done.
+  template <typename Func>
+  void ForDynamicChunks(size_t begin, size_t end, size_t chunk, Func func) {
+    if (begin >= end) return;
+
+    chunk = std::max<size_t>(chunk, 1);
+    ThreadPool::Instance().Run((end - begin + chunk - 1) / chunk, [begin, end, chunk, &func](size_t idx) {
+      const size_t chunk_begin = begin + idx * chunk;
+      func(chunk_begin, std::min(chunk_begin + chunk, end));
+    });
+  }
+}
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <functional>
 #include <iostream>
+#include <list>
 #include <memory>
 #include <string_view>
 #include <optional>
+#include <vector>
 
 #include "database.h"
 #include "json.h"
@@ -13,13 +16,12 @@ namespace busdb {
 struct AbstractData {
     AbstractData(int request_id);
 
-    Json::Node toJson() const;
+    // writes the response object, members in key order
+    virtual void toJson(Json::Writer& writer) const = 0;
     virtual std::ostream& toStream(std::ostream& out) const = 0;
     virtual ~AbstractData() = default;
 
     int request_id;
-protected:
-    virtual Json::Object toJsonObject() const = 0;
 };
 
 std::ostream& operator<<(std::ostream& out, const AbstractData& data);
@@ -33,10 +35,25 @@ struct Request {
 
     virtual void ParseFrom(std::string_view input) = 0;
 
-    virtual void ParseFrom(const Json::Object& data) = 0;
+    // reads the request object member by member
+    void ParseFrom(Json::Reader& reader);
 
     virtual ~Request() = default;
     const Type type;
+
+protected:
+    // reads the value of a member, returns false if the member is unknown and has to be skipped
+    virtual bool ParseField(std::string_view key, Json::Reader& reader);
+
+    // called after the last member, throws std::out_of_range if a required member is missing
+    virtual void FinishParsing();
+
+    // throws std::out_of_range, as Json::Object::at does, if ParseField took no such member
+    void Require(std::string_view member) const;
+
+private:
+    // KeyHash of the members ParseField took, while the object is read
+    std::vector<uint64_t> parsed_members_;
 };
 
 struct ReadRequest: Request {
@@ -46,13 +63,17 @@ struct ReadRequest: Request {
 
     virtual std::unique_ptr<AbstractData> Process(const DataBase& db) const = 0;
 
-    virtual void ParseFrom(std::string_view input) = 0;
-
-    virtual void ParseFrom(const Json::Object& data) override;
-
-    virtual void ParseOther(const Json::Object& data) = 0;
+    // Processes requests on all threads a window at a time and passes the responses to write in request order,
+    // at most a window of responses is held. Route requests from the same stop within a window
+    // are answered together, by one search
+    static void ProcessAll(const std::list<std::unique_ptr<ReadRequest>>& requests, const DataBase& db,
+                           const std::function<void(const AbstractData&)>& write);
 
     int id = -1;
+
+protected:
+    bool ParseField(std::string_view key, Json::Reader& reader) override;
+    void FinishParsing() override;
 };
 
 struct ModifyRequest: Request {
@@ -66,6 +87,10 @@ struct ModifyRequest: Request {
 std::optional<Request::Type>
 ConvertRequestTypeFromString(std::string_view type_str);
 
+// the type member may follow the others, it is looked up ahead on a copy of the reader
+std::optional<Request::Type>
+FindJsonRequestType(Json::Reader reader);
+
 template<class RequestType>
 std::unique_ptr<RequestType> ParseRequest(std::string_view request_str) {
     const auto request_type = ConvertRequestTypeFromString(ReadToken(request_str));
@@ -82,16 +107,13 @@ std::unique_ptr<RequestType> ParseRequest(std::string_view request_str) {
 }
 
 template<class RequestType>
-std::unique_ptr<RequestType> ParseJsonRequest(const Json::Node& input) {
-    const auto& data = input.AsObject();
-    const auto request_type = ConvertRequestTypeFromString(data.at("type").AsString());
-    if (!request_type) {
-        return nullptr;
-    }
-
-    auto request = RequestType::Create(*request_type);
+std::unique_ptr<RequestType> ParseJsonRequest(Json::Reader& reader) {
+    const auto request_type = FindJsonRequestType(reader);
+    auto request = request_type ? RequestType::Create(*request_type) : nullptr;
     if (request) {
-        request->ParseFrom(data);
+        request->ParseFrom(reader);
+    } else {
+        reader.Skip();
     }
 
     return request;
@@ -1,59 +1,84 @@
 #pragma once
 
-#include<set>
+#include<array>
 #include<iostream>
-#include<list>
 #include<memory>
+#include<string>
 #include<string_view>
+#include<vector>
 
 #include "common.h"
-#include "json.h"
+#include "name_pool.h"
 
 namespace busdb {
 
 class DataBase;
 
-class Route {
-protected:
-    using StopsContainer = std::set<std::string>;
+// what a Bus request answers
+struct RouteStats {
+    DistanceType length;
+    DistanceType line_length;
+    double curvature;
+    size_t stop_count;
+    size_t unique_stop_count;
+};
 
+class Route {
 public:
     Route() = default;
 
-    void SetDB(const DataBase* db);
+    // interns the parsed stop names, from then on stops are known by their ids
+    void SetDB(const DataBase* db, NamePool& stop_names);
+
+    // stops as they were given, already interned
+    void SetStops(const DataBase* db, std::vector<StopId> stops);
 
-    const StopsContainer& UniqueStops() const;
+    // sorted by id
+    const std::vector<StopId>& UniqueStops() const;
 
-    const std::list<StopsContainer::const_iterator>& Stops() const;
+    const std::vector<StopId>& Stops() const;
 
     DistanceType Distance() const;
 
     DistanceType LineDistance() const;
 
-    Json::Object ToJsonObject() const;
+    RouteStats Stats() const;
+
+    // stats of the route with lengths that were found elsewhere
+    RouteStats Stats(DistanceType length, DistanceType line_length) const;
+
+    virtual std::array<StopId, 2> EdgeStops() const = 0;
+
+    virtual bool IsRoundtrip() const = 0;
+
+    // stops as they were given, a two-way route goes back over them
+    std::vector<StopId> BaseStops() const;
 
-    virtual std::array<StopsContainer::const_iterator, 2> EdgeStops() const = 0;
+    // an empty route of the kind, for SetStops
+    static std::unique_ptr<Route> Create(bool is_roundtrip);
 
     static std::unique_ptr<Route> ParseRoute(std::string_view route_str);
 
-    static std::unique_ptr<Route> ParseRoute(const Json::Object& data);
+    static std::unique_ptr<Route> ParseRoute(std::vector<std::string> stops, bool is_roundtrip);
 
     virtual ~Route() = default;
 
 protected:
     void ParseFrom(std::string_view input);
 
-    void ParseFrom(const Json::Object& data);
+    void ParseFrom(std::vector<std::string> stops);
 
     virtual std::string_view Delimiter() const = 0;
 
     virtual void FillRoute() = 0;
 
-    StopsContainer stops_;
-    std::list<StopsContainer::const_iterator> route_;
+    // as parsed, until the route is added to a database
+    std::vector<std::string> stop_names_;
+    std::vector<StopId> stops_;
+    std::vector<StopId> route_;
     const DataBase* db_ = nullptr;
 };
 
-std::ostream& operator<<(std::ostream& out, const Route& r);
+std::ostream& operator<<(std::ostream& out, const RouteStats& stats);
 
 }
@@ -1,14 +1,22 @@
 #pragma once
 
+#include "contraction_hierarchy.h"
+#include "dijkstra.h"
 #include "graph.h"
+#include "parallel.h"
+#include "routes_matrix.h"
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <iterator>
+#include <memory>
 #include <optional>
-#include <unordered_map>
+#include <type_traits>
 #include <utility>
+#include <variant>
 #include <vector>
 
 namespace Graph {
@@ -16,123 +24,446 @@ namespace Graph {
   template <typename Weight>
   class Router {
   private:
-    using Graph = DirectedWeightedGraph<Weight>;
+    using Graph = FrozenGraph<Weight>;
 
   public:
-    Router(const Graph& graph);
+    enum class Mode {
+      // all pairs are precomputed in constructor: O(V^3) time, O(V^2) memory
+      ALL_PAIRS = 0,
+      // same result as ALL_PAIRS, precomputation is cache-blocked and runs on all cores
+      ALL_PAIRS_BLOCKED,
+      // every route is searched on request: O(V + E) memory, no precomputation
+      ON_DEMAND,
+      // routes are searched in a contraction hierarchy built in constructor
+      CONTRACTION_HIERARCHY,
+      // same as ON_DEMAND, the search is directed to the target by a lower bound of the remaining weight
+      A_STAR
+    };
+
+    // Type of weights kept in the all-pairs matrix
+    enum class MatrixWeight {
+      NATIVE = 0,
+      // half the memory for double weights, route weights are summed up from the graph edges,
+      // routes with almost equal weights can be told apart wrongly
+      FLOAT
+    };
+
+    Router(const Graph& graph, Mode mode = Mode::ALL_PAIRS, MatrixWeight matrix_weight = MatrixWeight::NATIVE);
+    // CONTRACTION_HIERARCHY mode over a hierarchy built or loaded beforehand
+    Router(const Graph& graph, std::unique_ptr<ContractionHierarchy<Weight>> hierarchy);
 
-    using RouteId = uint64_t;
+    // lower_bound(from, to) never exceeds the weight of the route from `from` to `to`
+    // and is consistent: it never drops along an edge by more than the edge weight
+    using LowerBound = std::function<Weight(VertexId from, VertexId to)>;
+    // A_STAR mode
+    Router(const Graph& graph, LowerBound lower_bound);
 
-    struct RouteInfo {
-      RouteId id;
-      Weight weight;
-      size_t edge_count;
+    // Same mode over `graph`, which is the graph of `router` with edges appended.
+    // Searching modes take it as is, all-pairs data is copied and relaxed through the new edges only,
+    // O(V^2) per edge; a contraction hierarchy is built anew.
+    Router(const Router& router, const Graph& graph);
+
+    // Search buffers of one thread. Queries don't change the router,
+    // so routes are built concurrently when every thread has its own workspace.
+    class Workspace {
+    private:
+      friend Router;
+      Workspace() = default;
+
+      std::unique_ptr<Dijkstra<Weight>> dijkstra;
+      std::unique_ptr<typename ContractionHierarchy<Weight>::Query> hierarchy_query;
+      // source of the last search in dijkstra, its settled vertices have their final routes
+      std::optional<VertexId> searched_from;
     };
 
-    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
-    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
-    void ReleaseRoute(RouteId route_id);
+    Workspace CreateWorkspace() const;
+
+    // Writes edges of the best route in travel order into `edges` and returns its weight,
+    // nullopt if `to` can't be reached. Nothing is allocated once the buffers have grown.
+    std::optional<Weight> BuildRoute(VertexId from, VertexId to, Workspace& workspace, std::vector<EdgeId>& edges) const;
+
+    // Prepares routes from one vertex to each of `to`: searching modes build one shortest path tree
+    // which the following BuildRoute calls from `from` to these vertices read.
+    void PrepareRoutes(VertexId from, const std::vector<VertexId>& to, Workspace& workspace) const;
 
   private:
     const Graph& graph_;
+    const Mode mode_;
 
-    struct RouteInternalData {
-      Weight weight;
-      std::optional<EdgeId> prev_edge;
-    };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
+    template <typename StoredWeight>
+    using RoutesInternalData = RoutesMatrix<StoredWeight>;
 
-    using ExpandedRoute = std::vector<EdgeId>;
-    mutable RouteId next_route_id_ = 0;
-    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
+    template <typename StoredWeight>
+    void InitializeRoutesInternalData(RoutesInternalData<StoredWeight>& routes_internal_data) {
+      using StoredEdgeId = typename RoutesInternalData<StoredWeight>::StoredEdgeId;
+      assert(graph_.GetEdgeCount() < RoutesInternalData<StoredWeight>::NO_EDGE);
 
-    void InitializeRoutesInternalData(const Graph& graph) {
-      const size_t vertex_count = graph.GetVertexCount();
+      const size_t vertex_count = graph_.GetVertexCount();
       for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-        routes_internal_data_[vertex][vertex] = RouteInternalData{0, std::nullopt};
-        for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
-          const auto& edge = graph.GetEdge(edge_id);
+        StoredWeight* weights = routes_internal_data.Weights(vertex);
+        StoredEdgeId* prev_edges = routes_internal_data.PrevEdges(vertex);
+        weights[vertex] = 0;
+        for (const auto& edge : graph_.GetIncidentEdges(vertex)) {
           assert(edge.weight >= 0);
-          auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-          if (!route_internal_data || route_internal_data->weight > edge.weight) {
-            route_internal_data = RouteInternalData{edge.weight, edge_id};
+          const auto edge_weight = static_cast<StoredWeight>(edge.weight);
+          if (weights[edge.to] > edge_weight) {
+            weights[edge.to] = edge_weight;
+            prev_edges[edge.to] = static_cast<StoredEdgeId>(edge.id);
           }
         }
       }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to,
-                    const RouteInternalData& route_from, const RouteInternalData& route_to) {
-      auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-      const Weight candidate_weight = route_from.weight + route_to.weight;
-      if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-        route_relaxing = {
-            candidate_weight,
-            route_to.prev_edge
-                ? route_to.prev_edge
-                : route_from.prev_edge
-        };
+    template <typename StoredWeight>
+    static void RelaxRoutesInternalDataThroughVertex(RoutesInternalData<StoredWeight>& routes_internal_data,
+                                                     VertexId vertex_through) {
+      const size_t vertex_count = routes_internal_data.GetVertexCount();
+      const StoredWeight* weights_to = routes_internal_data.Weights(vertex_through);
+      const auto* prev_edges_to = routes_internal_data.PrevEdges(vertex_through);
+      for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
+        const StoredWeight weight_from = routes_internal_data.Weights(vertex_from)[vertex_through];
+        if (weight_from != RoutesInternalData<StoredWeight>::INF) {
+          RoutesInternalData<StoredWeight>::RelaxRow(
+              routes_internal_data.Weights(vertex_from), routes_internal_data.PrevEdges(vertex_from),
+              weight_from, routes_internal_data.PrevEdges(vertex_from)[vertex_through],
+              weights_to, prev_edges_to, 0, vertex_count);
+        }
       }
     }
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
-      for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-        if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-          for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-            if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-              RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
+    // Updates routes with an edge added after they were built. Routes to the edge's start and from its end
+    // can't get better through it, so every row is relaxed with the row of the edge's end independently.
+    template <typename StoredWeight>
+    void RelaxRoutesInternalDataThroughEdge(RoutesInternalData<StoredWeight>& routes_internal_data, EdgeId edge_id) {
+      using Matrix = RoutesInternalData<StoredWeight>;
+      assert(edge_id < Matrix::NO_EDGE);
+
+      const auto edge = graph_.GetEdge(edge_id);
+      assert(edge.weight >= 0);
+      const auto edge_weight = static_cast<StoredWeight>(edge.weight);
+      const StoredWeight* weights_to = routes_internal_data.Weights(edge.to);
+      const auto* prev_edges_to = routes_internal_data.PrevEdges(edge.to);
+      const size_t vertex_count = routes_internal_data.GetVertexCount();
+
+      Parallel::ForChunks(0, vertex_count, [&](VertexId rows_begin, VertexId rows_end) {
+        for (VertexId vertex_from = rows_begin; vertex_from < rows_end; ++vertex_from) {
+          const StoredWeight weight_from = routes_internal_data.Weights(vertex_from)[edge.from];
+          if (vertex_from != edge.to && weight_from != Matrix::INF) {
+            Matrix::RelaxRow(routes_internal_data.Weights(vertex_from), routes_internal_data.PrevEdges(vertex_from),
+                             weight_from + edge_weight, static_cast<typename Matrix::StoredEdgeId>(edge_id),
+                             weights_to, prev_edges_to, 0, vertex_count);
+          }
+        }
+      });
+    }
+
+    // Blocked variant of the loop over RelaxRoutesInternalDataThroughVertex.
+    // Every row still sees the relaxations in exactly the same order as in the plain loop,
+    // so weights and prev edges are bit-identical: the rounds of a block of pivots are applied
+    // to a row one after another while the row and the pivot rows' tile stay in cache.
+    static constexpr size_t PIVOT_BLOCK_SIZE = 32;
+    static constexpr size_t COLUMN_TILE_SIZE = 512;
+
+    template <typename StoredWeight>
+    struct PivotRows {
+      using StoredEdgeId = typename RoutesInternalData<StoredWeight>::StoredEdgeId;
+
+      explicit PivotRows(size_t vertex_count)
+          : vertex_count(vertex_count),
+            weights(PIVOT_BLOCK_SIZE * vertex_count),
+            prev_edges(PIVOT_BLOCK_SIZE * vertex_count) {}
+
+      StoredWeight* Weights(size_t pivot_idx) { return weights.data() + pivot_idx * vertex_count; }
+      const StoredWeight* Weights(size_t pivot_idx) const { return weights.data() + pivot_idx * vertex_count; }
+      StoredEdgeId* PrevEdges(size_t pivot_idx) { return prev_edges.data() + pivot_idx * vertex_count; }
+      const StoredEdgeId* PrevEdges(size_t pivot_idx) const { return prev_edges.data() + pivot_idx * vertex_count; }
+
+      size_t vertex_count;
+      std::vector<StoredWeight> weights;
+      std::vector<StoredEdgeId> prev_edges;
+    };
+
+    template <typename StoredWeight>
+    static void RelaxRoutesInternalDataBlocked(RoutesInternalData<StoredWeight>& routes_internal_data) {
+      using Matrix = RoutesInternalData<StoredWeight>;
+      const size_t vertex_count = routes_internal_data.GetVertexCount();
+
+      PivotRows<StoredWeight> pivot_rows(vertex_count);
+      for (VertexId block_begin = 0; block_begin < vertex_count; block_begin += PIVOT_BLOCK_SIZE) {
+        const VertexId block_end = std::min(block_begin + PIVOT_BLOCK_SIZE, vertex_count);
+
+        // A pivot row doesn't change in its own round, so a copy taken before that round
+        // is what every other row has to be relaxed with, whatever later rounds do to the pivot row.
+        for (VertexId vertex_through = block_begin; vertex_through < block_end; ++vertex_through) {
+          const size_t pivot_idx = vertex_through - block_begin;
+          std::copy_n(routes_internal_data.Weights(vertex_through), vertex_count, pivot_rows.Weights(pivot_idx));
+          std::copy_n(routes_internal_data.PrevEdges(vertex_through), vertex_count, pivot_rows.PrevEdges(pivot_idx));
+
+          for (VertexId vertex_from = block_begin; vertex_from < block_end; ++vertex_from) {
+            const StoredWeight weight_from = routes_internal_data.Weights(vertex_from)[vertex_through];
+            if (vertex_from != vertex_through && weight_from != Matrix::INF) {
+              Matrix::RelaxRow(routes_internal_data.Weights(vertex_from), routes_internal_data.PrevEdges(vertex_from),
+                               weight_from, routes_internal_data.PrevEdges(vertex_from)[vertex_through],
+                               pivot_rows.Weights(pivot_idx), pivot_rows.PrevEdges(pivot_idx), 0, vertex_count);
             }
           }
         }
+
+        Parallel::ForChunks(0, vertex_count, [&](VertexId rows_begin, VertexId rows_end) {
+          for (VertexId vertex_from = rows_begin; vertex_from < rows_end; ++vertex_from) {
+            if (vertex_from < block_begin || vertex_from >= block_end) {
+              RelaxRowThroughBlock(routes_internal_data.Weights(vertex_from), routes_internal_data.PrevEdges(vertex_from),
+                                   block_begin, block_end, pivot_rows);
+            }
+          }
+        });
+      }
+    }
+
+    template <typename StoredWeight>
+    static void RelaxRowThroughBlock(StoredWeight* weights, typename RoutesInternalData<StoredWeight>::StoredEdgeId* prev_edges,
+                                     VertexId block_begin, VertexId block_end,
+                                     const PivotRows<StoredWeight>& pivot_rows) {
+      using Matrix = RoutesInternalData<StoredWeight>;
+      const size_t vertex_count = pivot_rows.vertex_count;
+
+      // values the row has in the pivot columns at the start of each pivot's round,
+      // pivot columns only depend on each other within the block
+      std::array<StoredWeight, PIVOT_BLOCK_SIZE> weights_from;
+      std::array<typename Matrix::StoredEdgeId, PIVOT_BLOCK_SIZE> prev_edges_from;
+      for (VertexId vertex_through = block_begin; vertex_through < block_end; ++vertex_through) {
+        const size_t pivot_idx = vertex_through - block_begin;
+        weights_from[pivot_idx] = weights[vertex_through];
+        prev_edges_from[pivot_idx] = prev_edges[vertex_through];
+        if (weights_from[pivot_idx] != Matrix::INF) {
+          Matrix::RelaxRow(weights, prev_edges, weights_from[pivot_idx], prev_edges_from[pivot_idx],
+                           pivot_rows.Weights(pivot_idx), pivot_rows.PrevEdges(pivot_idx), block_begin, block_end);
+        }
+      }
+
+      // pivot columns are final already, relaxing them once more doesn't change them
+      for (VertexId column_begin = 0; column_begin < vertex_count; column_begin += COLUMN_TILE_SIZE) {
+        const VertexId column_end = std::min(column_begin + COLUMN_TILE_SIZE, vertex_count);
+        for (VertexId vertex_through = block_begin; vertex_through < block_end; ++vertex_through) {
+          const size_t pivot_idx = vertex_through - block_begin;
+          if (weights_from[pivot_idx] != Matrix::INF) {
+            Matrix::RelaxRow(weights, prev_edges, weights_from[pivot_idx], prev_edges_from[pivot_idx],
+                             pivot_rows.Weights(pivot_idx), pivot_rows.PrevEdges(pivot_idx), column_begin, column_end);
+          }
+        }
+      }
+    }
+
+    template <typename StoredWeight>
+    void BuildRoutesInternalData(RoutesInternalData<StoredWeight>& routes_internal_data) {
+      InitializeRoutesInternalData(routes_internal_data);
+
+      if (mode_ == Mode::ALL_PAIRS_BLOCKED) {
+        RelaxRoutesInternalDataBlocked(routes_internal_data);
+        return;
+      }
+
+      const size_t vertex_count = graph_.GetVertexCount();
+      for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
+        RelaxRoutesInternalDataThroughVertex(routes_internal_data, vertex_through);
       }
     }
 
-    RoutesInternalData routes_internal_data_;
+    // at most one of the matrices is built
+    std::variant<std::monostate, RoutesInternalData<Weight>, RoutesInternalData<float>> routes_internal_data_;
+
+    LowerBound lower_bound_;
+
+    std::unique_ptr<ContractionHierarchy<Weight>> hierarchy_;
+
+    bool IsSearching() const;
+
+    template <typename StoredWeight>
+    std::optional<Weight> BuildAllPairsRoute(const RoutesInternalData<StoredWeight>& routes_internal_data,
+                                             VertexId from, VertexId to, std::vector<EdgeId>& edges) const;
+    std::optional<Weight> BuildOnDemandRoute(VertexId from, VertexId to, Workspace& workspace,
+                                             std::vector<EdgeId>& edges) const;
+    std::optional<Weight> BuildHierarchyRoute(VertexId from, VertexId to, Workspace& workspace,
+                                              std::vector<EdgeId>& edges) const;
   };
 
 
   template <typename Weight>
-  Router<Weight>::Router(const Graph& graph)
+  Router<Weight>::Router(const Graph& graph, Mode mode, MatrixWeight matrix_weight)
       : graph_(graph),
-        routes_internal_data_(graph.GetVertexCount(), std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+        mode_(mode)
   {
-    InitializeRoutesInternalData(graph);
+    // A_STAR without a lower bound is a plain search
+    if (IsSearching()) {
+      return;
+    }
 
-    const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-      RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    if (mode_ == Mode::CONTRACTION_HIERARCHY) {
+      hierarchy_ = std::make_unique<ContractionHierarchy<Weight>>(graph);
+      return;
+    }
+
+    if (matrix_weight == MatrixWeight::FLOAT) {
+      BuildRoutesInternalData(routes_internal_data_.template emplace<2>(graph.GetVertexCount()));
+    } else {
+      BuildRoutesInternalData(routes_internal_data_.template emplace<1>(graph.GetVertexCount()));
     }
   }
 
   template <typename Weight>
-  std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_[from][to];
-    if (!route_internal_data) {
+  Router<Weight>::Router(const Graph& graph, std::unique_ptr<ContractionHierarchy<Weight>> hierarchy)
+      : graph_(graph),
+        mode_(Mode::CONTRACTION_HIERARCHY),
+        hierarchy_(std::move(hierarchy))
+  {
+    assert(hierarchy_->GetVertexCount() == graph.GetVertexCount());
+  }
+
+  template <typename Weight>
+  Router<Weight>::Router(const Graph& graph, LowerBound lower_bound)
+      : graph_(graph),
+        mode_(Mode::A_STAR),
+        lower_bound_(std::move(lower_bound))
+  {
+  }
+
+  template <typename Weight>
+  Router<Weight>::Router(const Router& router, const Graph& graph)
+      : graph_(graph),
+        mode_(router.mode_),
+        routes_internal_data_(router.routes_internal_data_),
+        lower_bound_(router.lower_bound_)
+  {
+    assert(graph.GetVertexCount() == router.graph_.GetVertexCount());
+    assert(graph.GetEdgeCount() >= router.graph_.GetEdgeCount());
+
+    if (mode_ == Mode::CONTRACTION_HIERARCHY) {
+      hierarchy_ = std::make_unique<ContractionHierarchy<Weight>>(graph);
+      return;
+    }
+
+    std::visit([this, &router](auto& routes_internal_data) {
+      if constexpr (!std::is_same_v<std::decay_t<decltype(routes_internal_data)>, std::monostate>) {
+        for (EdgeId edge_id = router.graph_.GetEdgeCount(); edge_id < graph_.GetEdgeCount(); ++edge_id) {
+          RelaxRoutesInternalDataThroughEdge(routes_internal_data, edge_id);
+        }
+      }
+    }, routes_internal_data_);
+  }
+
+  template <typename Weight>
+  bool Router<Weight>::IsSearching() const {
+    return mode_ == Mode::ON_DEMAND || mode_ == Mode::A_STAR;
+  }
+
+  template <typename Weight>
+  typename Router<Weight>::Workspace Router<Weight>::CreateWorkspace() const {
+    Workspace workspace;
+    if (IsSearching()) {
+      workspace.dijkstra = std::make_unique<Dijkstra<Weight>>(graph_);
+    } else if (mode_ == Mode::CONTRACTION_HIERARCHY) {
+      workspace.hierarchy_query = std::make_unique<typename ContractionHierarchy<Weight>::Query>(*hierarchy_);
+    }
+    return workspace;
+  }
+
+  template <typename Weight>
+  std::optional<Weight> Router<Weight>::BuildRoute(VertexId from, VertexId to, Workspace& workspace,
+                                                   std::vector<EdgeId>& edges) const {
+    if (IsSearching()) {
+      return BuildOnDemandRoute(from, to, workspace, edges);
+    }
+    if (mode_ == Mode::CONTRACTION_HIERARCHY) {
+      return BuildHierarchyRoute(from, to, workspace, edges);
+    }
+
+    return std::visit([this, from, to, &edges](const auto& routes_internal_data) -> std::optional<Weight> {
+      if constexpr (std::is_same_v<std::decay_t<decltype(routes_internal_data)>, std::monostate>) {
+        return std::nullopt;
+      } else {
+        return BuildAllPairsRoute(routes_internal_data, from, to, edges);
+      }
+    }, routes_internal_data_);
+  }
+
+  template <typename Weight>
+  void Router<Weight>::PrepareRoutes(VertexId from, const std::vector<VertexId>& to, Workspace& workspace) const {
+    // a lower bound only directs the search to a single target
+    if (!IsSearching() || to.size() < 2) {
+      return;
+    }
+
+    workspace.dijkstra->Run(from, to);
+    workspace.searched_from = from;
+  }
+
+  template <typename Weight>
+  template <typename StoredWeight>
+  std::optional<Weight> Router<Weight>::BuildAllPairsRoute(const RoutesInternalData<StoredWeight>& routes_internal_data,
+                                                           VertexId from, VertexId to, std::vector<EdgeId>& edges) const {
+    using Matrix = RoutesInternalData<StoredWeight>;
+
+    edges.clear();
+    const StoredWeight stored_weight = routes_internal_data.Weights(from)[to];
+    if (stored_weight == Matrix::INF) {
       return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
-    std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge) {
-      edges.push_back(*edge_id);
+
+    const auto* prev_edges = routes_internal_data.PrevEdges(from);
+    for (auto edge_id = prev_edges[to];
+         edge_id != Matrix::NO_EDGE;
+         edge_id = prev_edges[graph_.GetEdge(edge_id).from]) {
+      edges.push_back(edge_id);
     }
     std::reverse(std::begin(edges), std::end(edges));
 
-    const RouteId route_id = next_route_id_++;
-    const size_t route_edge_count = edges.size();
-    expanded_routes_cache_[route_id] = std::move(edges);
-    return RouteInfo{route_id, weight, route_edge_count};
+    if constexpr (std::is_same_v<StoredWeight, Weight>) {
+      return stored_weight;
+    } else {
+      Weight weight = {};
+      for (const EdgeId edge_id : edges) {
+        weight += graph_.GetEdge(edge_id).weight;
+      }
+      return weight;
+    }
   }
 
   template <typename Weight>
-  EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
-    return expanded_routes_cache_.at(route_id)[edge_idx];
+  std::optional<Weight> Router<Weight>::BuildOnDemandRoute(VertexId from, VertexId to, Workspace& workspace,
+                                                           std::vector<EdgeId>& edges) const {
+    auto& dijkstra = *workspace.dijkstra;
+    // a settled vertex of the last search from the same source already has its best route
+    if (workspace.searched_from != from || !dijkstra.IsSettled(to)) {
+      if (lower_bound_) {
+        dijkstra.Run(from, to, [this, to](VertexId vertex) { return lower_bound_(vertex, to); });
+      } else {
+        dijkstra.Run(from, to);
+      }
+      workspace.searched_from = from;
+    }
+
+    edges.clear();
+    if (!dijkstra.IsReached(to)) {
+      return std::nullopt;
+    }
+
+    dijkstra.GetPath(to, edges);
+    return dijkstra.GetWeight(to);
   }
 
   template <typename Weight>
-  void Router<Weight>::ReleaseRoute(RouteId route_id) {
-    expanded_routes_cache_.erase(route_id);
+  std::optional<Weight> Router<Weight>::BuildHierarchyRoute(VertexId from, VertexId to, Workspace& workspace,
+                                                            std::vector<EdgeId>& edges) const {
+    if (!workspace.hierarchy_query->Run(from, to, edges)) {
+      return std::nullopt;
+    }
+
+    // summed up in travel order, the way a plain search would
+    Weight weight = {};
+    for (const EdgeId edge_id : edges) {
+      weight += graph_.GetEdge(edge_id).weight;
+    }
+    return weight;
   }
 
 }
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "graph.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace Graph {
+
+  // All-pairs weights and last edges of the best routes in two flat row-major arrays.
+  // Missing routes are marked with INF weight and NO_EDGE instead of std::optional,
+  // edge ids are stored in 32 bits, so a cell takes sizeof(StoredWeight) + 4 bytes.
+  template <typename StoredWeight>
+  class RoutesMatrix {
+  public:
+    using StoredEdgeId = uint32_t;
+
+    static constexpr StoredWeight INF = std::numeric_limits<StoredWeight>::infinity();
+    static constexpr StoredEdgeId NO_EDGE = std::numeric_limits<StoredEdgeId>::max();
+
+    explicit RoutesMatrix(size_t vertex_count)
+        : vertex_count_(vertex_count),
+          weights_(vertex_count * vertex_count, INF),
+          prev_edges_(vertex_count * vertex_count, NO_EDGE)
+    {
+    }
+
+    size_t GetVertexCount() const { return vertex_count_; }
+
+    StoredWeight* Weights(VertexId from) { return weights_.data() + from * vertex_count_; }
+    const StoredWeight* Weights(VertexId from) const { return weights_.data() + from * vertex_count_; }
+    StoredEdgeId* PrevEdges(VertexId from) { return prev_edges_.data() + from * vertex_count_; }
+    const StoredEdgeId* PrevEdges(VertexId from) const { return prev_edges_.data() + from * vertex_count_; }
+
+    // Relaxes row cells [column_begin, column_end) with the routes through a vertex:
+    // the row reaches it with (weight_from, prev_edge_from), the vertex' own row is (pivot_weights, pivot_prev_edges).
+    // A cell is replaced only by a strictly better candidate, its last edge is the pivot's one
+    // unless the pivot cell is the vertex itself.
+    static void RelaxRow(StoredWeight* weights, StoredEdgeId* prev_edges,
+                         StoredWeight weight_from, StoredEdgeId prev_edge_from,
+                         const StoredWeight* pivot_weights, const StoredEdgeId* pivot_prev_edges,
+                         size_t column_begin, size_t column_end);
+
+  private:
+    size_t vertex_count_;
+    std::vector<StoredWeight> weights_;
+    std::vector<StoredEdgeId> prev_edges_;
+
+    static void RelaxCells(StoredWeight* weights, StoredEdgeId* prev_edges,
+                           StoredWeight weight_from, StoredEdgeId prev_edge_from,
+                           const StoredWeight* pivot_weights, const StoredEdgeId* pivot_prev_edges,
+                           size_t column_begin, size_t column_end) {
+      for (size_t column = column_begin; column < column_end; ++column) {
+        const StoredWeight candidate_weight = weight_from + pivot_weights[column];
+        if (candidate_weight < weights[column]) {
+          weights[column] = candidate_weight;
+          prev_edges[column] = pivot_prev_edges[column] != NO_EDGE ? pivot_prev_edges[column] : prev_edge_from;
+        }
+      }
+    }
+  };
+
+  template <typename StoredWeight>
+  void RoutesMatrix<StoredWeight>::RelaxRow(StoredWeight* weights, StoredEdgeId* prev_edges,
+                                            StoredWeight weight_from, StoredEdgeId prev_edge_from,
+                                            const StoredWeight* pivot_weights, const StoredEdgeId* pivot_prev_edges,
+                                            size_t column_begin, size_t column_end) {
+    RelaxCells(weights, prev_edges, weight_from, prev_edge_from, pivot_weights, pivot_prev_edges,
+               column_begin, column_end);
+  }
+
+#ifdef __AVX2__
+  template <>
+  inline void RoutesMatrix<double>::RelaxRow(double* weights, StoredEdgeId* prev_edges,
+                                             double weight_from, StoredEdgeId prev_edge_from,
+                                             const double* pivot_weights, const StoredEdgeId* pivot_prev_edges,
+                                             size_t column_begin, size_t column_end) {
+    const __m256d from = _mm256_set1_pd(weight_from);
+    const __m128i from_edge = _mm_set1_epi32(static_cast<int>(prev_edge_from));
+    const __m128i no_edge = _mm_set1_epi32(static_cast<int>(NO_EDGE));
+    // picks the low halves of four 64-bit compare results
+    const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+    size_t column = column_begin;
+    for (; column + 4 <= column_end; column += 4) {
+      const __m256d candidate = _mm256_add_pd(from, _mm256_loadu_pd(pivot_weights + column));
+      const __m256d current = _mm256_loadu_pd(weights + column);
+      const __m256d better = _mm256_cmp_pd(candidate, current, _CMP_LT_OQ);
+      if (_mm256_movemask_pd(better) == 0) continue;
+
+      _mm256_storeu_pd(weights + column, _mm256_blendv_pd(current, candidate, better));
+
+      const __m128i better_edges = _mm256_castsi256_si128(
+          _mm256_permutevar8x32_epi32(_mm256_castpd_si256(better), low_halves));
+      const __m128i pivot_edge = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pivot_prev_edges + column));
+      const __m128i candidate_edge = _mm_blendv_epi8(pivot_edge, from_edge, _mm_cmpeq_epi32(pivot_edge, no_edge));
+      auto* current_edge_ptr = reinterpret_cast<__m128i*>(prev_edges + column);
+      _mm_storeu_si128(current_edge_ptr,
+                       _mm_blendv_epi8(_mm_loadu_si128(current_edge_ptr), candidate_edge, better_edges));
+    }
+
+    RelaxCells(weights, prev_edges, weight_from, prev_edge_from, pivot_weights, pivot_prev_edges, column, column_end);
+  }
+
+  template <>
+  inline void RoutesMatrix<float>::RelaxRow(float* weights, StoredEdgeId* prev_edges,
+                                            float weight_from, StoredEdgeId prev_edge_from,
+                                            const float* pivot_weights, const StoredEdgeId* pivot_prev_edges,
+                                            size_t column_begin, size_t column_end) {
+    const __m256 from = _mm256_set1_ps(weight_from);
+    const __m256i from_edge = _mm256_set1_epi32(static_cast<int>(prev_edge_from));
+    const __m256i no_edge = _mm256_set1_epi32(static_cast<int>(NO_EDGE));
+
+    size_t column = column_begin;
+    for (; column + 8 <= column_end; column += 8) {
+      const __m256 candidate = _mm256_add_ps(from, _mm256_loadu_ps(pivot_weights + column));
+      const __m256 current = _mm256_loadu_ps(weights + column);
+      const __m256 better = _mm256_cmp_ps(candidate, current, _CMP_LT_OQ);
+      if (_mm256_movemask_ps(better) == 0) continue;
+
+      _mm256_storeu_ps(weights + column, _mm256_blendv_ps(current, candidate, better));
+
+      const __m256i pivot_edge = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pivot_prev_edges + column));
+      const __m256i candidate_edge = _mm256_blendv_epi8(pivot_edge, from_edge, _mm256_cmpeq_epi32(pivot_edge, no_edge));
+      auto* current_edge_ptr = reinterpret_cast<__m256i*>(prev_edges + column);
+      _mm256_storeu_si256(current_edge_ptr,
+                          _mm256_blendv_epi8(_mm256_loadu_si256(current_edge_ptr), candidate_edge,
+                                             _mm256_castps_si256(better)));
+    }
+
+    RelaxCells(weights, prev_edges, weight_from, prev_edge_from, pivot_weights, pivot_prev_edges, column, column_end);
+  }
+#endif
+}
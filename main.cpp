@@ -1,13 +1,18 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <optional>
+#include <string_view>
 #include <vector>
 #include <memory>
 
+#include "base_file.h"
 #include "common.h"
 #include "database.h"
 #include "request.h"
 #include "json.h"
 #include "code_profile.h"
+#include "parallel.h"
 
 using namespace busdb;
 using namespace Json;
@@ -29,12 +34,13 @@ namespace {
     }
 
     template<class RequestType>
-    auto ReadJsonRequests(const Array &in_data) {
+    auto ReadJsonRequests(Reader &reader) {
         LOG_DURATION("ReadJsonRequests");
         std::list<std::unique_ptr<RequestType>> requests;
 
-        for (auto &item: in_data) {
-            if (auto request = ParseJsonRequest<RequestType>(item)) {
+        reader.BeginArray();
+        while (reader.NextItem()) {
+            if (auto request = ParseJsonRequest<RequestType>(reader)) {
                 requests.push_back(move(request));
             }
         }
@@ -42,6 +48,47 @@ namespace {
         return requests;
     }
 
+    // Items are found by a structural scan first, then parsed in chunks of about the same size on all threads.
+    // Chunks are joined in document order, so requests are processed in the same order as when read one by one
+    template<class RequestType>
+    auto ReadJsonRequestsInParallel(Reader &reader) {
+        LOG_DURATION("ReadJsonRequestsInParallel");
+        const auto items = reader.FindArrayItems();
+        if (items.empty()) return std::list<std::unique_ptr<RequestType>>();
+
+        const size_t chunk_count = std::min(Parallel::ThreadCount(), items.size());
+        const size_t first_offset = items.front().first;
+        const size_t total_size = items.back().second - first_offset;
+        // first item of every chunk and the end
+        std::vector<size_t> chunk_items(chunk_count + 1, items.size());
+        for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+            const size_t chunk_offset = first_offset + total_size / chunk_count * chunk;
+            chunk_items[chunk] = std::lower_bound(items.begin(), items.end(), chunk_offset,
+                                                  [](const auto& item, size_t offset) {
+                return item.first < offset;
+            }) - items.begin();
+        }
+
+        std::vector<std::vector<std::unique_ptr<RequestType>>> chunks(chunk_count);
+        Parallel::ForChunks(0, chunk_count, [&](size_t chunks_begin, size_t chunks_end) {
+            for (size_t chunk = chunks_begin; chunk < chunks_end; ++chunk) {
+                for (size_t idx = chunk_items[chunk]; idx < chunk_items[chunk + 1]; ++idx) {
+                    auto item_reader = reader.Slice(items[idx].first, items[idx].second);
+                    if (auto request = ParseJsonRequest<RequestType>(item_reader)) {
+                        chunks[chunk].push_back(move(request));
+                    }
+                    item_reader.Finish();
+                }
+            }
+        });
+
+        std::list<std::unique_ptr<RequestType>> requests;
+        for (auto& chunk: chunks) {
+            std::move(chunk.begin(), chunk.end(), std::back_inserter(requests));
+        }
+        return requests;
+    }
+
     template<class RequestContainer>
     void ProcessModifyRequest(const RequestContainer &requests, DataBase &db) {
         {
@@ -59,44 +106,38 @@ namespace {
     }
 
     template<class RequestContainer>
-    auto ProcessReadRequests(
-            const RequestContainer &requests, const DataBase &db) {
+    void PrintResponses(const RequestContainer &requests, const DataBase &db,
+                        std::ostream &out_stream = std::cout) {
         LOG_DURATION("ProcessReadRequests");
-        std::list<std::unique_ptr<AbstractData>> responses;
-        for (const auto &request: requests) {
-            responses.push_back(request->Process(db));
-        }
-        return responses;
+        ReadRequest::ProcessAll(requests, db, [&out_stream](const AbstractData &response) {
+            out_stream << response << std::endl;
+        });
     }
 
-    template<class ResponseContainer>
-    auto ResponsesToDocument(const ResponseContainer &responses) {
-        LOG_DURATION("ResponsesToDocument");
-        auto json_responses = Array();
-        json_responses.reserve(responses.size());
-
-        for (const auto &response: responses) {
-            json_responses.push_back(response->toJson());
-        }
-
-        return Document(json_responses);
-    }
-
-    template<class ResponseContainer>
-    void PrintResponses(const ResponseContainer &responses,
-                        std::ostream &out_stream = std::cout) {
-        for (const auto &response: responses) {
-            out_stream << *response << std::endl;
-        }
+    template<class RequestContainer>
+    void WriteJsonResponses(const RequestContainer &requests, const DataBase &db,
+                            std::ostream &out_stream = std::cout) {
+        LOG_DURATION("ProcessReadRequests");
+        Writer writer(out_stream);
+        writer.BeginArray();
+        ReadRequest::ProcessAll(requests, db, [&writer](const AbstractData &response) {
+            response.toJson(writer);
+        });
+        writer.EndArray();
     }
 }
 
-int main() {
+// bus_db [--base FILE] [--convert-base FILE]
+//   --base FILE          load stops, buses and settings of a converted base file before the input,
+//                        settings of the input take precedence
+//   --convert-base FILE  convert base requests and settings of the input into FILE, answer nothing
+int main(int argc, char** argv) {
     LOG_DURATION("Total")
     DataBase db;
     std::ostream& out = std::cout;
     out.precision(6);
 
+#ifdef PLAN_TEXT
 #ifdef DEBUG
     std::ifstream ifs("input.json");
     std::istream& in = ifs;
@@ -104,28 +145,76 @@ int main() {
     std::istream& in = std::cin;
 #endif
 
-#ifdef PLAN_TEXT
     const auto modify_requests = ReadRequests<ModifyRequest>(in);
     const auto read_requests = ReadRequests<ReadRequest>(in);
 
     ProcessModifyRequest(modify_requests, db);
-    PrintResponses(ProcessReadRequests(read_requests, db), out);
+    PrintResponses(read_requests, db, out);
 #else
-    auto in_data = Load(in);
-    auto& requests = in_data.GetRoot().AsObject();
+    std::optional<std::string> base_file, converted_file;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view option = argv[i];
+        if (option == "--base") {
+            base_file = argv[i + 1];
+        } else if (option == "--convert-base") {
+            converted_file = argv[i + 1];
+        } else {
+            std::cerr << "unknown option " << option << std::endl;
+            return 1;
+        }
+    }
 
-    db.SetRouteSettings(requests);
-    const auto modify_requests = ReadJsonRequests<ModifyRequest>(
-            requests.at("base_requests").AsArray());
-    const auto read_requests = ReadJsonRequests<ReadRequest>(
-            requests.at("stat_requests").AsArray());
+#ifdef DEBUG
+    const auto in_data = Buffer::FromFile("input.json");
+#else
+    const auto in_data = Buffer::FromStream(std::cin);
+#endif
+    // requests are decoded straight from the input, only the settings become Nodes
+    Reader reader(in_data.View());
+    Object settings;
+    std::list<std::unique_ptr<ModifyRequest>> modify_requests;
+    std::list<std::unique_ptr<ReadRequest>> read_requests;
+
+    reader.BeginObject();
+    for (std::string_view key; reader.NextKey(key);) {
+        if (key == "base_requests") {
+            // on one thread the scan ahead would only add to the parsing
+            modify_requests = Parallel::ThreadCount() > 1 ? ReadJsonRequestsInParallel<ModifyRequest>(reader)
+                                                          : ReadJsonRequests<ModifyRequest>(reader);
+        } else if (key == "stat_requests") {
+            read_requests = ReadJsonRequests<ReadRequest>(reader);
+        } else {
+            auto name = std::string(key);
+            settings.emplace(move(name), reader.ReadNode());
+        }
+    }
+    reader.Finish();
+
+    // strings of the base file settings are views into it
+    std::optional<Buffer> base_data;
+    if (base_file) {
+        LOG_DURATION("LoadBase");
+        base_data = Buffer::FromFile(*base_file);
+        for (const auto& [key, value]: BaseFile::Read(base_data->View(), db)) {
+            settings.emplace(key, value);
+        }
+    }
+
+    if (converted_file) {
+        for (const auto& request: modify_requests) {
+            request->Process(db);
+        }
+        std::ofstream output(*converted_file, std::ios::binary);
+        BaseFile::Write(output, db, settings);
+        return output ? 0 : 1;
+    }
 
+    db.SetRouteSettings(settings);
     ProcessModifyRequest(modify_requests, db);
     // Important should be after fill data in db
-    db.SetRenderSettings(requests);
+    db.SetRenderSettings(settings);
 
-    auto doc = ResponsesToDocument(ProcessReadRequests(read_requests, db));
-    Save(doc, out);
+    WriteJsonResponses(read_requests, db, out);
 #endif
 
     return 0;
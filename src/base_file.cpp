@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "base_file.h"
+#include "route.h"
+
+using namespace busdb;
+using namespace Json;
+
+namespace {
+
+constexpr char MAGIC[8] = {'B', 'U', 'S', 'D', 'B', 'A', 'S', 'E'};
+constexpr uint32_t VERSION = 1;
+// reads back differently on a machine of the other byte order
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+class ImageWriter {
+public:
+    explicit ImageWriter(std::ostream& output) :
+            output(output) {
+    }
+
+    template <typename T>
+    void Put(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        output.write(reinterpret_cast<const char*>(&value), sizeof value);
+    }
+
+    template <typename T>
+    void PutArray(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Put<uint64_t>(values.size());
+        output.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void PutString(std::string_view value) {
+        Put<uint64_t>(value.size());
+        output.write(value.data(), value.size());
+    }
+
+    // offsets of the names in one string of all of them
+    void PutNames(const NamePool& names) {
+        std::vector<uint32_t> offsets = {0};
+        std::string data;
+        for (NameId id = 0; id < names.Size(); ++id) {
+            data += names.Name(id);
+            offsets.push_back(static_cast<uint32_t>(data.size()));
+        }
+        PutArray(offsets);
+        PutString(data);
+    }
+
+    void PutNode(const Node& node) {
+        const auto type = static_cast<Node::Type>(node.index());
+        switch (type) {
+            case Node::Type::ArrayType:
+                Put(type);
+                Put<uint64_t>(node.AsArray().size());
+                for (const auto& item: node.AsArray()) {
+                    PutNode(item);
+                }
+                break;
+            case Node::Type::ObjectType:
+                Put(type);
+                Put<uint64_t>(node.AsObject().size());
+                for (const auto& [key, value]: node.AsObject()) {
+                    PutString(key);
+                    PutNode(value);
+                }
+                break;
+            case Node::Type::IntType:
+                Put(type);
+                Put(node.AsInt());
+                break;
+            case Node::Type::DoubleType:
+                Put(type);
+                Put(node.AsDouble());
+                break;
+            case Node::Type::BooleanType:
+                Put(type);
+                Put<uint8_t>(node.AsBoolean());
+                break;
+            case Node::Type::StringType:
+            case Node::Type::StringViewType:
+                Put(Node::Type::StringViewType);
+                PutString(node.AsString());
+                break;
+        }
+    }
+
+private:
+    std::ostream& output;
+};
+
+class ImageReader {
+public:
+    explicit ImageReader(std::string_view image) :
+            image(image) {
+    }
+
+    template <typename T>
+    T Get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(1, sizeof value), sizeof value);
+        return value;
+    }
+
+    template <typename T>
+    std::vector<T> GetArray() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto size = Get<uint64_t>();
+        const char* data = Take(size, sizeof(T));
+        std::vector<T> values(size);
+        std::memcpy(values.data(), data, size * sizeof(T));
+        return values;
+    }
+
+    std::string_view GetString() {
+        const auto size = Get<uint64_t>();
+        return {Take(size, 1), size};
+    }
+
+    void GetNames(NamePool& names) {
+        const auto offsets = GetArray<uint32_t>();
+        const auto data = GetString();
+        if (offsets.empty() || offsets.front() != 0 || offsets.back() != data.size()
+            || !std::is_sorted(offsets.begin(), offsets.end())) {
+            Fail("bad string table");
+        }
+
+        for (size_t id = 0; id + 1 < offsets.size(); ++id) {
+            if (names.Intern(data.substr(offsets[id], offsets[id + 1] - offsets[id])) != id) {
+                Fail("repeated name");
+            }
+        }
+    }
+
+    // settings nest a few levels, a deeper node is a damaged file and must not run out of stack
+    Node GetNode(size_t depth = 0) {
+        if (depth > MAX_NODE_DEPTH) {
+            Fail("settings nested too deep");
+        }
+
+        switch (Get<Node::Type>()) {
+            case Node::Type::ArrayType: {
+                Array items;
+                // an item takes at least its type, the count is checked before anything is allocated
+                items.resize(GetCount(sizeof(Node::Type)));
+                for (auto& item: items) {
+                    item = GetNode(depth + 1);
+                }
+                return items;
+            }
+            case Node::Type::ObjectType: {
+                std::pmr::vector<Object::Member> members;
+                // a member takes at least the size of its key and its type
+                for (auto count = GetCount(sizeof(uint64_t) + sizeof(Node::Type)); count > 0; --count) {
+                    std::pmr::string key(GetString());
+                    members.emplace_back(std::move(key), GetNode(depth + 1));
+                }
+                return Object(std::move(members));
+            }
+            case Node::Type::IntType:
+                return Get<int>();
+            case Node::Type::DoubleType:
+                return Get<double>();
+            case Node::Type::BooleanType:
+                return Get<uint8_t>() != 0;
+            case Node::Type::StringViewType:
+                return GetString();
+            default:
+                Fail("bad settings");
+        }
+    }
+
+    void Finish() const {
+        if (!image.empty()) {
+            Fail("unexpected data after the end");
+        }
+    }
+
+    [[noreturn]] static void Fail(const std::string& what) {
+        throw std::runtime_error("base file: " + what);
+    }
+
+private:
+    static constexpr size_t MAX_NODE_DEPTH = 64;
+
+    std::string_view image;
+
+    // a count of items that each take at least min_size of the bytes left
+    size_t GetCount(size_t min_size) {
+        const auto count = Get<uint64_t>();
+        if (count > image.size() / min_size) {
+            Fail("truncated");
+        }
+        return count;
+    }
+
+    const char* Take(size_t count, size_t size) {
+        if (count > image.size() / size) {
+            Fail("truncated");
+        }
+        const char* data = image.data();
+        image.remove_prefix(count * size);
+        return data;
+    }
+};
+}
+
+namespace busdb {
+
+void DataBase::SaveBase(std::ostream& out) const {
+    ImageWriter image(out);
+    image.PutNames(stop_names_);
+    image.PutNames(bus_names_);
+
+    std::vector<uint8_t> stop_flags(stops_.size());
+    std::vector<Point> locations(stops_.size());
+    for (StopId stop = 0; stop < stops_.size(); ++stop) {
+        stop_flags[stop] = (stops_[stop] ? HAS_LOCATION : 0) | (stop_buses_.count(stop) ? HAS_BUSES : 0);
+        locations[stop] = stops_[stop].value_or(Point{});
+    }
+    image.PutArray(stop_flags);
+    image.PutArray(locations);
+
+    // sorted, the same base always gives the same file
+    std::vector<std::pair<uint64_t, DistanceType>> distances(distance_hash_.begin(), distance_hash_.end());
+    std::sort(distances.begin(), distances.end());
+    std::vector<uint64_t> distance_keys;
+    std::vector<DistanceType> distance_values;
+    distance_keys.reserve(distances.size());
+    distance_values.reserve(distances.size());
+    for (const auto& [key, distance]: distances) {
+        distance_keys.push_back(key);
+        distance_values.push_back(distance);
+    }
+    image.PutArray(distance_keys);
+    image.PutArray(distance_values);
+
+    // stops of bus i are route_stops[route_offsets[i], route_offsets[i + 1])
+    std::vector<uint8_t> roundtrip;
+    std::vector<uint32_t> route_offsets = {0};
+    std::vector<StopId> route_stops;
+    for (const auto& route: buses_) {
+        const auto stops = route->BaseStops();
+        roundtrip.push_back(route->IsRoundtrip());
+        route_stops.insert(route_stops.end(), stops.begin(), stops.end());
+        route_offsets.push_back(static_cast<uint32_t>(route_stops.size()));
+    }
+    image.PutArray(roundtrip);
+    image.PutArray(route_offsets);
+    image.PutArray(route_stops);
+}
+
+void DataBase::LoadBase(std::string_view data) {
+    if (stop_names_.Size() || bus_names_.Size()) {
+        throw std::logic_error("a base is loaded into an empty database");
+    }
+
+    ImageReader image(data);
+    image.GetNames(stop_names_);
+    image.GetNames(bus_names_);
+    const auto stops_count = stop_names_.Size();
+
+    const auto stop_flags = image.GetArray<uint8_t>();
+    const auto locations = image.GetArray<Point>();
+    if (stop_flags.size() != stops_count || locations.size() != stops_count) {
+        ImageReader::Fail("bad stops");
+    }
+    stops_.resize(stops_count);
+    for (StopId stop = 0; stop < stops_count; ++stop) {
+        if (stop_flags[stop] & HAS_LOCATION) stops_[stop] = locations[stop];
+        if (stop_flags[stop] & HAS_BUSES) stop_buses_[stop];
+    }
+
+    const auto distance_keys = image.GetArray<uint64_t>();
+    const auto distance_values = image.GetArray<DistanceType>();
+    if (distance_keys.size() != distance_values.size()) {
+        ImageReader::Fail("bad distances");
+    }
+    distance_hash_.reserve(distance_keys.size());
+    for (size_t i = 0; i < distance_keys.size(); ++i) {
+        if ((distance_keys[i] >> 32) >= stops_count || (distance_keys[i] & UINT32_MAX) >= stops_count) {
+            ImageReader::Fail("bad distances");
+        }
+        distance_hash_.emplace(distance_keys[i], distance_values[i]);
+    }
+
+    const auto roundtrip = image.GetArray<uint8_t>();
+    const auto route_offsets = image.GetArray<uint32_t>();
+    const auto route_stops = image.GetArray<StopId>();
+    image.Finish();
+    if (roundtrip.size() != bus_names_.Size() || route_offsets.size() != roundtrip.size() + 1
+        || route_offsets.front() != 0 || route_offsets.back() != route_stops.size()
+        || !std::is_sorted(route_offsets.begin(), route_offsets.end())
+        || std::any_of(route_stops.begin(), route_stops.end(), [stops_count](StopId stop) {
+            return stop >= stops_count;
+        })) {
+        ImageReader::Fail("bad buses");
+    }
+
+    buses_.reserve(roundtrip.size());
+    for (BusId bus = 0; bus < roundtrip.size(); ++bus) {
+        auto route = Route::Create(roundtrip[bus]);
+        route->SetStops(this, {route_stops.begin() + route_offsets[bus], route_stops.begin() + route_offsets[bus + 1]});
+        for (const auto stop : route->UniqueStops())
+            stop_buses_[stop].push_back(bus);
+
+        buses_.push_back(move(route));
+    }
+}
+
+}
+
+namespace BaseFile {
+
+void Write(std::ostream& output, const DataBase& db, const Object& settings) {
+    ImageWriter image(output);
+    output.write(MAGIC, sizeof MAGIC);
+    image.Put(VERSION);
+    image.Put(BYTE_ORDER_MARK);
+
+    std::ostringstream settings_section(std::ios::binary);
+    ImageWriter(settings_section).PutNode(settings);
+    image.PutString(settings_section.str());
+
+    std::ostringstream base_section(std::ios::binary);
+    db.SaveBase(base_section);
+    image.PutString(base_section.str());
+}
+
+Object Read(std::string_view image, DataBase& db) {
+    if (image.substr(0, sizeof MAGIC) != std::string_view(MAGIC, sizeof MAGIC)) {
+        ImageReader::Fail("not a base file");
+    }
+    ImageReader reader(image.substr(sizeof MAGIC));
+    if (reader.Get<uint32_t>() != VERSION) {
+        ImageReader::Fail("unknown version");
+    }
+    if (reader.Get<uint32_t>() != BYTE_ORDER_MARK) {
+        ImageReader::Fail("written with another byte order");
+    }
+
+    ImageReader settings_section(reader.GetString());
+    auto settings = settings_section.GetNode();
+    settings_section.Finish();
+    if (static_cast<Node::Type>(settings.index()) != Node::Type::ObjectType) {
+        ImageReader::Fail("bad settings");
+    }
+
+    db.LoadBase(reader.GetString());
+    reader.Finish();
+
+    return settings.AsObject();
+}
+
+}
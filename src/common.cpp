@@ -1,4 +1,5 @@
 #include "common.h"
+#include "numbers.h"
 #include <cmath>
 #include <sstream>
 
@@ -28,29 +29,21 @@ std::string_view ReadToken(std::string_view& s, std::string_view delimiter) {
 }
 
 int ConvertToInt(std::string_view str) {
-    // use std::from_chars when available to git rid of string copy
-    size_t pos;
-    const int result = stoi(std::string(str), &pos);
-    if (pos != str.length()) {
-        std::stringstream error;
-        error << "string " << str << " contains " << (str.length() - pos)
-                << " trailing chars";
-        throw std::invalid_argument(error.str());
+    if (const auto result = Numbers::ParseInt(str)) {
+        return *result;
     }
-    return result;
+    std::stringstream error;
+    error << "string " << str << " is not an int";
+    throw std::invalid_argument(error.str());
 }
 
 double ConvertToDouble(std::string_view str) {
-    // use std::from_chars when available to git rid of string copy
-    size_t pos;
-    const auto result = stod(std::string(str), &pos);
-    if (pos != str.length()) {
-        std::stringstream error;
-        error << "string " << str << " contains " << (str.length() - pos)
-                << " trailing chars";
-        throw std::invalid_argument(error.str());
+    if (const auto result = Numbers::ParseDouble(str)) {
+        return *result;
     }
-    return result;
+    std::stringstream error;
+    error << "string " << str << " is not a double";
+    throw std::invalid_argument(error.str());
 }
 
 int Point::R = 6371000;
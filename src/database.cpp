@@ -1,18 +1,41 @@
 #include <optional>
 #include <memory>
+#include <fstream>
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include "database.h"
 #include "route.h"
 #include "render_impl.h"
+#include "parallel.h"
 
 using namespace Graph;
 
+namespace {
+    const std::unordered_map<std::string_view, Router<double>::Mode> STR_TO_ROUTER_MODE = {
+            {"all_pairs", Router<double>::Mode::ALL_PAIRS},
+            {"all_pairs_blocked", Router<double>::Mode::ALL_PAIRS_BLOCKED},
+            {"on_demand", Router<double>::Mode::ON_DEMAND},
+            {"contraction_hierarchy", Router<double>::Mode::CONTRACTION_HIERARCHY},
+            {"a_star", Router<double>::Mode::A_STAR}
+    };
+
+    // computed great-circle distances of close points are off by a tiny fraction,
+    // a slightly lowered bound stays consistent
+    constexpr double LOWER_BOUND_SCALE = 1 - 1e-6;
+}
+
 namespace busdb {
 
-DataBase::DataBase(){
+DataBase::DataBase() : compacted_(std::make_shared<Compacted>()) {
 
 }
 
@@ -20,122 +43,528 @@ DataBase::~DataBase(){
 
 }
 
-DistanceType DataBase::LineDistance(const std::string& stop1, const std::string& stop2) const {
-    return busdb::Distance(stops_.at(stop1), stops_.at(stop2));
+size_t DataBase::Compacted::StopCount() const {
+    return stop_flags.size();
 }
 
-DistanceType DataBase::Distance(const std::string& stop1, const std::string& stop2) const {
-    if (auto it1 = distance_hash_.find(stop1); it1 != distance_hash_.end()) {
-        if (auto it2 = it1->second.find(stop2); it2 != it1->second.end()) {
-            return it2->second;
-        }
+bool DataBase::Compacted::HasLocation(StopId stop) const {
+    return stop < StopCount() && stop_flags[stop] & HAS_LOCATION;
+}
+
+Point DataBase::Compacted::Location(StopId stop) const {
+    return {latitudes[stop], longitudes[stop]};
+}
+
+std::optional<DistanceType> DataBase::Compacted::FindDistance(StopId stop1, StopId stop2) const {
+    if (stop1 >= StopCount()) return std::nullopt;
+
+    const auto first = distance_to.begin() + distance_offsets[stop1];
+    const auto last = distance_to.begin() + distance_offsets[stop1 + 1];
+    if (auto it = std::lower_bound(first, last, stop2); it != last && *it == stop2) {
+        return distances[it - distance_to.begin()];
+    }
+    return std::nullopt;
+}
+
+DistanceType DataBase::Compacted::LineDistance(StopId stop1, StopId stop2) const {
+    if (!HasLocation(stop1) || !HasLocation(stop2)) {
+        throw std::out_of_range("stop has no location");
+    }
+    return geo_points.Distance(stop1, stop2);
+}
+
+DistanceType DataBase::Compacted::LineDistance(const std::vector<StopId>& stops) const {
+    if (!std::all_of(stops.begin(), stops.end(), [this](StopId stop) { return HasLocation(stop); })) {
+        throw std::out_of_range("stop has no location");
+    }
+    return geo_points.PathDistance(stops);
+}
+
+DistanceType DataBase::Compacted::Distance(StopId stop1, StopId stop2) const {
+    if (auto distance = FindDistance(stop1, stop2)) {
+        return *distance;
+    }
+
+    // not a neighbour on any route, nothing is stored
+    if (HasLocation(stop1) && HasLocation(stop2)) {
+        return LineDistance(stop1, stop2);
     }
+    return { };
+}
+
+RouteStats DataBase::Compacted::Stats(const Route& route) const {
+    // neighbours in route order, as Route::Distance adds them up
+    const auto& stops = route.Stops();
+    DistanceType length = { };
+    for (size_t i = 1; i < stops.size(); ++i) {
+        length += Distance(stops[i - 1], stops[i]);
+    }
+    return route.Stats(length, LineDistance(stops));
+}
 
-    DistanceType res = { };
-    auto it_s1 = stops_.find(stop1), it_s2 = stops_.find(stop2);
-    if (it_s1 != stops_.end() && it_s2 != stops_.end()) {
-        res = distance_hash_[it_s1->first][it_s2->first] = LineDistance(stop1,
-                stop2);
+void DataBase::Compacted::InsertDistances(const std::vector<std::pair<uint64_t, DistanceType>>& added) {
+    std::vector<uint32_t> offsets = {0};
+    std::vector<StopId> to;
+    std::vector<DistanceType> values;
+    offsets.reserve(distance_offsets.size());
+    to.reserve(distance_to.size() + added.size());
+    values.reserve(distance_to.size() + added.size());
+
+    // rows are merged with the added pairs of their stop, one pass over both
+    auto added_it = added.begin();
+    for (StopId stop = 0; stop < StopCount(); ++stop) {
+        auto position = distance_offsets[stop];
+        const auto end = distance_offsets[stop + 1];
+        for (; added_it != added.end() && (added_it->first >> 32) == stop; ++added_it) {
+            const auto added_to = static_cast<StopId>(added_it->first);
+            for (; position < end && distance_to[position] < added_to; ++position) {
+                to.push_back(distance_to[position]);
+                values.push_back(distances[position]);
+            }
+            if (position < end && distance_to[position] == added_to) ++position;
+            to.push_back(added_to);
+            values.push_back(added_it->second);
+        }
+        for (; position < end; ++position) {
+            to.push_back(distance_to[position]);
+            values.push_back(distances[position]);
+        }
+        offsets.push_back(static_cast<uint32_t>(to.size()));
     }
 
-    return res;
+    distance_offsets = std::move(offsets);
+    distance_to = std::move(to);
+    distances = std::move(values);
+}
+
+DistanceType DataBase::LineDistance(StopId stop1, StopId stop2) const {
+    return std::atomic_load(&compacted_)->LineDistance(stop1, stop2);
+}
+
+DistanceType DataBase::LineDistance(const std::vector<StopId>& stops) const {
+    return std::atomic_load(&compacted_)->LineDistance(stops);
+}
+
+DistanceType DataBase::Distance(StopId stop1, StopId stop2) const {
+    return std::atomic_load(&compacted_)->Distance(stop1, stop2);
+}
+
+StopId DataBase::InternStop(std::string_view stop) {
+    const auto id = stop_names_.Intern(stop);
+    if (id >= stops_.size()) stops_.resize(id + 1);
+    return id;
 }
 
 void DataBase::AddStop(std::string stop, Point location,
                        std::list<std::pair<std::string, int>> distances) {
-    auto [it, inserted] = stops_.insert({move(stop), location});
-    if(!inserted) it->second = location;
+    // stops laid out already may be on routes
+    const auto compacted_stops = compacted_->StopCount();
+    const auto stop_id = InternStop(stop);
+    stops_[stop_id] = location;
+    stop_buses_[stop_id];
+    bool changes_routes = stop_id < compacted_stops;
+
+    std::vector<StopId> another_ids;
+    another_ids.reserve(distances.size());
+    for(const auto& [another_stop_name, distance]: distances) {
+        const auto another_id = InternStop(another_stop_name);
+        if (!stops_[another_id]) {
+            stops_[another_id] = Point{};
+            changes_routes |= another_id < compacted_stops;
+        }
 
-    std::string_view stop_name = it->first;
-    if (stop_buses_.count(stop_name) == 0) {
-        stop_buses_[stop_name];
+        distance_hash_[DistanceKey(stop_id, another_id)] = distance;
+        distance_hash_.insert({DistanceKey(another_id, stop_id), distance});
+        another_ids.push_back(another_id);
     }
 
-    for(auto& [another_stop_name, distance]: distances) {
-        auto [another_it, temp] = stops_.insert( {move(another_stop_name), {}});
-        distance_hash_[stop_name][another_it->first] = distance;
+    if (!finalized_) return;
 
-        distance_hash_[another_it->first].insert( {stop_name, distance});
+    // stops are vertices, their distances change weights of many edges
+    if (changes_routes) {
+        if (routing_) BuildRoutes();
+        else Finalize();
+        return;
     }
+
+    // A new stop is on no route and has no edges, routes to and from it are not found.
+    // It gets its vertex when routes are built again
+    CompactStop(stop_id, another_ids);
 }
 
 void DataBase::AddBus(std::string number, std::shared_ptr<Route> route) {
-    route->SetDB(this);
-    auto [it, inserted] = buses_.insert( {move(number), move(route)});
+    const auto bus = bus_names_.Intern(number);
+    if (bus < buses_.size()) return;
 
-    if (inserted) {
-        std::string_view bus_number = it->first;
-        for (const auto& stop : it->second->UniqueStops())
-            stop_buses_[stop].insert(bus_number);
-    }
+    route->SetDB(this, stop_names_);
+    stops_.resize(stop_names_.Size());
+    for (const auto stop : route->UniqueStops())
+        stop_buses_[stop].push_back(bus);
+
+    buses_.push_back(move(route));
+    if (!finalized_) return;
+
+    CompactBus(bus);
+    if (routing_) UpdateRoutes(bus, *buses_.back());
 }
 
+// names are interned before the snapshot that has them is stored,
+// an id beyond the snapshot is of a stop or a bus that is being added
+
 std::shared_ptr<Route> DataBase::GetBusRoute(const std::string& number) const {
-    if (auto it = buses_.find(number); it != buses_.end())
-        return it->second;
+    const auto compacted = std::atomic_load(&compacted_);
+    if (auto bus = bus_names_.Find(number); bus && *bus < compacted->buses.size())
+        return compacted->buses[*bus];
 
     return nullptr;
 }
 
-std::optional<std::set<std::string_view>> DataBase::GetStopBuses(std::string_view stop) const {
-    if (auto it = stop_buses_.find(stop); it != stop_buses_.end())
-        return it->second;
+std::optional<RouteStats> DataBase::GetBusStats(std::string_view number) const {
+    const auto compacted = std::atomic_load(&compacted_);
+    const auto bus = bus_names_.Find(number);
+    if (!bus || *bus >= compacted->buses.size()) return std::nullopt;
 
-    return std::nullopt;
+    if (const auto& stats = compacted->bus_stats[*bus]) return stats;
+    // throws, as there is no line distance to a stop without a location
+    return compacted->Stats(*compacted->buses[*bus]);
+}
+
+std::optional<std::vector<std::string_view>> DataBase::GetStopBuses(std::string_view stop) const {
+    const auto compacted = std::atomic_load(&compacted_);
+    const auto stop_id = stop_names_.Find(stop);
+    if (!stop_id || *stop_id >= compacted->StopCount() || !(compacted->stop_flags[*stop_id] & HAS_BUSES))
+        return std::nullopt;
+
+    std::vector<std::string_view> buses;
+    const auto first = compacted->stop_bus_offsets[*stop_id], last = compacted->stop_bus_offsets[*stop_id + 1];
+    buses.reserve(last - first);
+    for (auto idx = first; idx < last; ++idx)
+        buses.push_back(bus_names_.Name(compacted->stop_buses[idx]));
+
+    return buses;
+}
+
+void DataBase::Finalize() {
+    const size_t stops_count = stop_names_.Size();
+    stops_.resize(stops_count);
+    Compacted compacted;
+
+    compacted.stop_flags.resize(stops_count);
+    compacted.latitudes.resize(stops_count);
+    compacted.longitudes.resize(stops_count);
+    for (StopId stop = 0; stop < stops_count; ++stop) {
+        if (const auto& location = stops_[stop]) {
+            compacted.stop_flags[stop] |= HAS_LOCATION;
+            compacted.latitudes[stop] = location->latitude;
+            compacted.longitudes[stop] = location->longitude;
+            compacted.stops_by_name.push_back(stop);
+        }
+    }
+    stop_names_.SortByName(compacted.stops_by_name);
+
+    compacted.geo_points.Reserve(stops_count);
+    for (StopId stop = 0; stop < stops_count; ++stop) {
+        compacted.geo_points.Add({compacted.latitudes[stop], compacted.longitudes[stop]});
+    }
+
+    compacted.buses_by_name.resize(buses_.size());
+    std::iota(compacted.buses_by_name.begin(), compacted.buses_by_name.end(), BusId{0});
+    bus_names_.SortByName(compacted.buses_by_name);
+
+    // spans are sized first, then filled going over buses in name order
+    compacted.stop_bus_offsets.assign(stops_count + 1, 0);
+    for (const auto& [stop, buses]: stop_buses_) {
+        compacted.stop_flags[stop] |= HAS_BUSES;
+        compacted.stop_bus_offsets[stop + 1] = buses.size();
+    }
+    std::partial_sum(compacted.stop_bus_offsets.begin(), compacted.stop_bus_offsets.end(),
+                     compacted.stop_bus_offsets.begin());
+    compacted.stop_buses.resize(compacted.stop_bus_offsets.back());
+    std::vector<uint32_t> stop_bus_ends(compacted.stop_bus_offsets.begin(), compacted.stop_bus_offsets.end() - 1);
+    for (const auto bus: compacted.buses_by_name) {
+        for (const auto stop: buses_[bus]->UniqueStops()) {
+            compacted.stop_buses[stop_bus_ends[stop]++] = bus;
+        }
+    }
+
+    // road distances, and line distances between neighbours on routes that have no road distance.
+    // Keys are ordered by the stop from, then by the stop to
+    std::vector<std::pair<uint64_t, DistanceType>> distances(distance_hash_.begin(), distance_hash_.end());
+    std::vector<StopId> line_from, line_to;
+    for (const auto& route: buses_) {
+        const auto& stops = route->Stops();
+        for (size_t i = 1; i < stops.size(); ++i) {
+            const auto from = stops[i - 1], to = stops[i];
+            if (stops_[from] && stops_[to] && !distance_hash_.count(DistanceKey(from, to))) {
+                line_from.push_back(from);
+                line_to.push_back(to);
+            }
+        }
+    }
+    std::vector<DistanceType> line_distances(line_from.size());
+    compacted.geo_points.Distances(line_from.data(), line_to.data(), line_from.size(), line_distances.data());
+    for (size_t i = 0; i < line_distances.size(); ++i) {
+        distances.emplace_back(DistanceKey(line_from[i], line_to[i]), line_distances[i]);
+    }
+    std::sort(distances.begin(), distances.end());
+    distances.erase(std::unique(distances.begin(), distances.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first == rhs.first;
+    }), distances.end());
+    compacted.distance_offsets.assign(stops_count + 1, 0);
+    compacted.distance_to.reserve(distances.size());
+    compacted.distances.reserve(distances.size());
+    for (const auto& [key, distance]: distances) {
+        ++compacted.distance_offsets[(key >> 32) + 1];
+        compacted.distance_to.push_back(static_cast<StopId>(key));
+        compacted.distances.push_back(distance);
+    }
+    std::partial_sum(compacted.distance_offsets.begin(), compacted.distance_offsets.end(),
+                     compacted.distance_offsets.begin());
+
+    // the distances above are read, each bus is counted on its own
+    compacted.buses = buses_;
+    compacted.bus_stats.resize(buses_.size());
+    Parallel::ForChunks(0, buses_.size(), [&compacted](size_t begin, size_t end) {
+        for (BusId bus = begin; bus < end; ++bus) {
+            const auto& stops = compacted.buses[bus]->Stops();
+            if (std::all_of(stops.begin(), stops.end(), [&compacted](StopId stop) {
+                return compacted.HasLocation(stop);
+            })) {
+                compacted.bus_stats[bus] = compacted.Stats(*compacted.buses[bus]);
+            }
+        }
+    });
+
+    std::atomic_store(&compacted_, std::shared_ptr<const Compacted>(std::make_shared<Compacted>(std::move(compacted))));
+    finalized_ = true;
+}
+
+void DataBase::AddCompactedStops(Compacted& compacted) const {
+    for (StopId stop = compacted.StopCount(); stop < stop_names_.Size(); ++stop) {
+        const auto& location = stops_[stop];
+        const Point point = location.value_or(Point{});
+        compacted.stop_flags.push_back((location ? HAS_LOCATION : 0) | (stop_buses_.count(stop) ? HAS_BUSES : 0));
+        compacted.latitudes.push_back(point.latitude);
+        compacted.longitudes.push_back(point.longitude);
+        compacted.geo_points.Add(point);
+        compacted.stop_bus_offsets.push_back(compacted.stop_bus_offsets.back());
+        compacted.distance_offsets.push_back(compacted.distance_offsets.back());
+
+        if (location) {
+            const auto position = std::lower_bound(compacted.stops_by_name.begin(), compacted.stops_by_name.end(),
+                                                   stop, [this](StopId lhs, StopId rhs) {
+                return stop_names_.Name(lhs) < stop_names_.Name(rhs);
+            });
+            compacted.stops_by_name.insert(position, stop);
+        }
+    }
+}
+
+void DataBase::CompactStop(StopId stop, const std::vector<StopId>& another_ids) {
+    auto compacted = std::make_shared<Compacted>(*compacted_);
+    AddCompactedStops(*compacted);
+
+    // both ways, as AddStop stored them
+    std::vector<std::pair<uint64_t, DistanceType>> distances;
+    distances.reserve(another_ids.size() * 2);
+    for (const auto another_id: another_ids) {
+        for (const auto key: {DistanceKey(stop, another_id), DistanceKey(another_id, stop)}) {
+            distances.emplace_back(key, distance_hash_.at(key));
+        }
+    }
+    std::sort(distances.begin(), distances.end());
+    distances.erase(std::unique(distances.begin(), distances.end()), distances.end());
+    compacted->InsertDistances(distances);
+
+    std::atomic_store(&compacted_, std::shared_ptr<const Compacted>(std::move(compacted)));
 }
-Graph::VertexId DataBase::GetWaitStopVertexId(std::string_view stop) const{
-    if(auto it = stop_to_vertex_.find(stop); it != stop_to_vertex_.end())
-         return it->second + stops_.size();
 
-     return -1;
+void DataBase::CompactBus(BusId bus) {
+    const auto& route = buses_[bus];
+    auto compacted = std::make_shared<Compacted>(*compacted_);
+    assert(compacted->buses.size() == bus);
+    // stops named first by the route
+    AddCompactedStops(*compacted);
+
+    const auto by_name = [this](BusId lhs, BusId rhs) {
+        return bus_names_.Name(lhs) < bus_names_.Name(rhs);
+    };
+
+    // the bus goes into the spans of its stops where its name is in order
+    const auto& unique_stops = route->UniqueStops();
+    std::vector<uint32_t> stop_bus_offsets = {0};
+    std::vector<BusId> stop_buses;
+    stop_bus_offsets.reserve(compacted->stop_bus_offsets.size());
+    stop_buses.reserve(compacted->stop_buses.size() + unique_stops.size());
+    auto next_stop = unique_stops.begin();
+    for (StopId stop = 0; stop < compacted->StopCount(); ++stop) {
+        const auto first = compacted->stop_buses.begin() + compacted->stop_bus_offsets[stop];
+        const auto last = compacted->stop_buses.begin() + compacted->stop_bus_offsets[stop + 1];
+        if (next_stop != unique_stops.end() && *next_stop == stop) {
+            const auto position = std::lower_bound(first, last, bus, by_name);
+            stop_buses.insert(stop_buses.end(), first, position);
+            stop_buses.push_back(bus);
+            stop_buses.insert(stop_buses.end(), position, last);
+            compacted->stop_flags[stop] |= HAS_BUSES;
+            ++next_stop;
+        } else {
+            stop_buses.insert(stop_buses.end(), first, last);
+        }
+        stop_bus_offsets.push_back(static_cast<uint32_t>(stop_buses.size()));
+    }
+    compacted->stop_bus_offsets = std::move(stop_bus_offsets);
+    compacted->stop_buses = std::move(stop_buses);
+
+    // line distances between neighbours that are in no table yet
+    std::vector<StopId> line_from, line_to;
+    const auto& stops = route->Stops();
+    for (size_t i = 1; i < stops.size(); ++i) {
+        const auto from = stops[i - 1], to = stops[i];
+        if (compacted->HasLocation(from) && compacted->HasLocation(to) && !compacted->FindDistance(from, to)) {
+            line_from.push_back(from);
+            line_to.push_back(to);
+        }
+    }
+    std::vector<DistanceType> line_distances(line_from.size());
+    compacted->geo_points.Distances(line_from.data(), line_to.data(), line_from.size(), line_distances.data());
+    std::vector<std::pair<uint64_t, DistanceType>> distances;
+    distances.reserve(line_distances.size());
+    for (size_t i = 0; i < line_distances.size(); ++i) {
+        distances.emplace_back(DistanceKey(line_from[i], line_to[i]), line_distances[i]);
+    }
+    std::sort(distances.begin(), distances.end());
+    distances.erase(std::unique(distances.begin(), distances.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first == rhs.first;
+    }), distances.end());
+    compacted->InsertDistances(distances);
+
+    compacted->buses_by_name.insert(std::lower_bound(compacted->buses_by_name.begin(),
+                                                     compacted->buses_by_name.end(), bus, by_name), bus);
+    compacted->buses.push_back(route);
+    const bool has_locations = std::all_of(stops.begin(), stops.end(), [&compacted](StopId stop) {
+        return compacted->HasLocation(stop);
+    });
+    compacted->bus_stats.push_back(has_locations ? std::optional(compacted->Stats(*route)) : std::nullopt);
+
+    std::atomic_store(&compacted_, std::shared_ptr<const Compacted>(std::move(compacted)));
+}
+
+bool DataBase::Routing::HasVertex(StopId stop) const {
+    return stop < stop_to_vertex.size() && stop_to_vertex[stop] != NO_VERTEX;
+}
+
+Graph::VertexId DataBase::Routing::GetWaitStopVertexId(StopId stop) const{
+    if (HasVertex(stop))
+         return stop_to_vertex[stop] + vertex2stop.size();
+
+     return NO_VERTEX;
 }
 
 
 std::tuple<double, DataBase::StopsRoute, Svg::Document>
 DataBase::GetRoute(const std::string& from, const std::string& to) const {
-    if (!router_) return {-1, {}, {}};
+    return std::move(GetRoutes(from, {to}).front());
+}
+
+std::vector<std::tuple<double, DataBase::StopsRoute, Svg::Document>>
+DataBase::GetRoutes(std::string_view from, const std::vector<std::string_view>& to) const {
+    std::vector<std::tuple<double, StopsRoute, Svg::Document>> routes(to.size(), {-1, {}, {}});
+    // the snapshot stays alive and unchanged while buses are added
+    const auto routing = std::atomic_load(&routing_);
+    if (!routing) return routes;
+    const auto& router = *routing->router;
 
     auto map = BuildMap();
     if (render_) render_->AddRect(map);
 
-    if (from == to) return {0, {}, std::move(map)};
+    // names are resolved once, unknown stops and stops without a location have no vertex
+    const auto wait_vertex = [this, &routing](std::string_view stop) {
+        const auto stop_id = stop_names_.Find(stop);
+        return stop_id ? routing->GetWaitStopVertexId(*stop_id) : Routing::NO_VERTEX;
+    };
+
+    // no route to or from a stop without a vertex, the router is not asked
+    const auto from_vertex = wait_vertex(from);
+    std::vector<size_t> searched_idx;
+    std::vector<Graph::VertexId> searched_vertices;
+    for (size_t idx = 0; idx < to.size(); ++idx) {
+        if (to[idx] == from) {
+            routes[idx] = {0, {}, map};
+        } else if (const auto to_vertex = wait_vertex(to[idx]);
+                   from_vertex != Routing::NO_VERTEX && to_vertex != Routing::NO_VERTEX) {
+            searched_idx.push_back(idx);
+            searched_vertices.push_back(to_vertex);
+        }
+    }
+    if (searched_vertices.empty()) return routes;
+
+    auto workspace = router.CreateWorkspace();
+    router.PrepareRoutes(from_vertex, searched_vertices, workspace);
 
-    auto info = router_->BuildRoute(GetWaitStopVertexId(from),  GetWaitStopVertexId(to));
-    if (!info) return {-1, {}, {}};
-    assert(info->edge_count >= 2);
+    const auto stops_size = routing->vertex2stop.size();
+    std::vector<EdgeId> edges;
+    for (size_t i = 0; i < searched_vertices.size(); ++i) {
+        if (auto weight = router.BuildRoute(from_vertex, searched_vertices[i], workspace, edges)) {
+            const auto to_stop = routing->vertex2stop[searched_vertices[i] - stops_size];
+            routes[searched_idx[i]] = ExpandRoute(*routing, *weight, edges, to_stop, map);
+        }
+    }
+
+    return routes;
+}
+
+std::tuple<double, DataBase::StopsRoute, Svg::Document>
+DataBase::ExpandRoute(const Routing& routing, double weight, const std::vector<EdgeId>& edges,
+                      StopId to, Svg::Document map) const {
+    assert(edges.size() >= 2);
 
-    // first stops_.size() edges are wait bus edges
-    const auto start_edge_id = stops_.size();
+    // first stops count edges are wait bus edges
+    const auto start_edge_id = routing.vertex2stop.size();
     StopsRoute route;
-    for (auto i = 0; i < info->edge_count; ++i) {
-        auto edge_id = router_->GetRouteEdge(info->id, i);
-        const auto& info = routes_->GetEdge(edge_id);
+    // ids of the route items, stops and buses in turn, ending with the last stop
+    std::vector<NameId> item_ids;
+    item_ids.reserve(edges.size() + 1);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        auto edge_id = edges[i];
+        const auto& edge = routing.graph->GetEdge(edge_id);
 
         if (i % 2 == 0) {
-            route.emplace_back(RouteItemType::WAIT, info.weight,
-                               vertex2stop_[info.to], 0);
+            const auto stop = routing.vertex2stop[edge.to];
+            route.emplace_back(RouteItemType::WAIT, edge.weight, stop_names_.Name(stop), 0);
+            item_ids.push_back(stop);
         } else {
             assert(edge_id >= start_edge_id);
-            const auto& [bus_number, span_count] = edge2bus_[edge_id - start_edge_id];
-            route.emplace_back(RouteItemType::BUS, info.weight, bus_number, span_count);
+            const auto& [bus, span_count] = routing.edge2bus[edge_id - start_edge_id];
+            route.emplace_back(RouteItemType::BUS, edge.weight, bus_names_.Name(bus), span_count);
+            item_ids.push_back(bus);
         }
     }
 
     if (render_) {
-        route.emplace_back(RouteItemType::WAIT, 0, to, 0);
-        render_->AddRoute(map, route);
-        route.pop_back();
+        item_ids.push_back(to);
+        render_->AddRoute(map, *routing.compacted, item_ids, route);
     }
 
-    router_->ReleaseRoute(info->id);
-    return {info->weight, std::move(route), std::move(map)};
+    return {weight, std::move(route), std::move(map)};
 }
 
 void DataBase::SetRouteSettings(const Json::Object& in_data) {
     if (in_data.count("routing_settings")) {
         const auto &s = in_data.at("routing_settings").AsObject();
         route_settings_ = {.bus_wait_time=s.at("bus_wait_time").AsInt(),
-                           .bus_velocity=s.at("bus_velocity").AsInt()};
+                           .bus_velocity=s.at("bus_velocity").AsInt(),
+                           .router_mode=Router<double>::Mode::ALL_PAIRS,
+                           .router_matrix_weight=Router<double>::MatrixWeight::NATIVE,
+                           .hierarchy_file=std::nullopt};
+        if (auto it = s.find("router_mode"); it != s.end()) {
+            route_settings_->router_mode = STR_TO_ROUTER_MODE.at(it->second.AsString());
+        }
+        if (auto it = s.find("router_float_matrix"); it != s.end() && it->second.AsBoolean()) {
+            route_settings_->router_matrix_weight = Router<double>::MatrixWeight::FLOAT;
+        }
+        if (auto it = s.find("contraction_hierarchy_file"); it != s.end()) {
+            route_settings_->hierarchy_file = std::string(it->second.AsString());
+        }
     }
 }
 
@@ -143,68 +572,250 @@ void DataBase::SetRenderSettings(const Json::Object& in_data) {
     if (in_data.count("render_settings") == 0 || render_)
         return;
 
-    render_ = std::make_unique<Render>(in_data.at("render_settings").AsObject(), stops_, buses_);
+    render_ = std::make_unique<Render>(in_data.at("render_settings").AsObject(), *this);
+}
+
+template <typename Func>
+void DataBase::ForEachBusEdge(const Route& route, const Routing& routing, Func func) const {
+    const auto& stops = route.Stops();
+    if (stops.size() < 2) return;
+
+    // route stops and road distances between neighbours are looked up once per route.
+    // Running sums from each stop, unlike differences of prefix sums, give exactly the times
+    // a stop to stop walk does, so buses with equal times stay equal.
+    std::vector<VertexId> vertices;
+    std::vector<double> span_distances;
+    vertices.reserve(stops.size());
+    span_distances.reserve(stops.size());
+    for (size_t i = 0; i < stops.size(); ++i) {
+        // a stop without a location is no vertex, the route has no edges
+        if (!routing.HasVertex(stops[i])) return;
+        vertices.push_back(routing.stop_to_vertex[stops[i]]);
+        if (i > 0) span_distances.push_back(compacted_->Distance(stops[i - 1], stops[i]));
+    }
+
+    double bus_velocity = route_settings_->bus_velocity;
+    for (size_t from = 0; from + 1 < vertices.size(); ++from) {
+        double distance = 0;
+        for (size_t to = from + 1; to < vertices.size(); ++to) {
+            distance += span_distances[to - 1];
+            double time = distance / bus_velocity / 1000 * 60;
+            func(vertices[from], vertices[to], time, static_cast<int>(to - from));
+        }
+    }
 }
 
 void DataBase::BuildRoutes() {
+    Finalize();
     if (!route_settings_) return;
 
     double bus_wait_time = route_settings_->bus_wait_time;
-    double bus_velocity  = route_settings_->bus_velocity;
 
-    auto stops_size = stops_.size();
+    auto routing = std::make_shared<Routing>();
+    routing->compacted = compacted_;
+    routing->vertex2stop = compacted_->stops_by_name;
+    const auto stops_size = routing->vertex2stop.size();
+    routing->stop_to_vertex.assign(stop_names_.Size(), Routing::NO_VERTEX);
 
-    vertex2stop_.reserve(stops_size);
-    vertex2stop_.clear();
-    stop_to_vertex_.clear();
-    edge2bus_.clear();
+    DirectedWeightedGraph<double> routes(stops_size * 2);
+    for (Graph::VertexId vertex = 0; vertex < stops_size; ++vertex) {
+        routes.AddEdge({vertex + stops_size, vertex, bus_wait_time});
+        routing->stop_to_vertex[routing->vertex2stop[vertex]] = vertex;
+    }
 
-    routes_ = std::make_unique<DirectedWeightedGraph<double>>(stops_.size() * 2);
-    Graph::VertexId current_vertex_id = {};
-    for (const auto& [stop_name, temp]: stops_) {
-        routes_->AddEdge({current_vertex_id + stops_size, current_vertex_id, bus_wait_time});
+    // edges of every bus are generated independently, the fastest bus between two stops is kept
+    const auto& buses = compacted_->buses_by_name;
+
+    // sparse (from, to) -> fastest edge tables, one per slice of buses.
+    // On equal times the bus that comes first wins, slices are merged in bus order.
+    using EdgeTable = std::unordered_map<uint64_t, BusEdge>;
+    const auto add_edge = [](EdgeTable& table, uint64_t key, const BusEdge& edge) {
+        auto [it, inserted] = table.insert({key, edge});
+        if (!inserted && it->second.time > edge.time) it->second = edge;
+    };
+
+    const size_t slice_count = std::max<size_t>(1, std::min(Parallel::ThreadCount(), buses.size()));
+    const size_t slice_size = (buses.size() + slice_count - 1) / slice_count;
+    std::vector<EdgeTable> slice_tables(slice_count);
+    Parallel::ForChunks(0, slice_count, [&](size_t slices_begin, size_t slices_end) {
+        for (size_t slice = slices_begin; slice < slices_end; ++slice) {
+            auto& table = slice_tables[slice];
+            const size_t buses_end = std::min(buses.size(), (slice + 1) * slice_size);
+            for (size_t idx = slice * slice_size; idx < buses_end; ++idx) {
+                const auto bus = buses[idx];
+                ForEachBusEdge(*buses_[bus], *routing, [&](
+                        VertexId v_from, VertexId v_to, double time, int span_count) {
+                    add_edge(table, v_from * stops_size + v_to, {v_from, v_to, time, span_count, bus});
+                });
+            }
+        }
+    });
 
-        vertex2stop_.push_back(stop_name);
-        stop_to_vertex_.insert({stop_name, current_vertex_id++});
+    auto& table = slice_tables.front();
+    for (size_t slice = 1; slice < slice_count; ++slice) {
+        for (const auto& [key, edge]: slice_tables[slice]) {
+            add_edge(table, key, edge);
+        }
+        slice_tables[slice] = {};
     }
 
-    std::vector<std::tuple<std::string_view, int, Edge<double>>> edge_hash(stops_size * stops_size,
-            {{}, {}, {}});
-    for(const auto& [bus_number, route]: buses_) {
-        const auto& stops = route->Stops();
-        if (stops.size() < 2) continue;
-
-        auto end = --stops.end();
-        for(auto it_from = stops.begin(); it_from != end; ++it_from) {
-            auto v_from = stop_to_vertex_[*(*it_from)];
-            auto span_count = 0;
-            double distance = 0;
-
-            auto begin = it_from;
-            for(auto it_to = ++begin, it_prev = it_from; it_to != stops.end(); ++it_to, ++it_prev) {
-                distance += Distance(*(*it_prev), *(*it_to));
-                span_count += 1;
-                double time = distance / bus_velocity / 1000 * 60;
-
-                auto v_to = stop_to_vertex_[*(*it_to)];
-                auto edge_hash_idx = v_from * stops_size + v_to;
-                auto& [edge_bus_number, edge_span_count, edge] = edge_hash[edge_hash_idx];
-                if (edge_span_count == 0 || edge.weight > time) {
-                    edge = {v_from, v_to + stops_size, time};
-                    edge_bus_number = bus_number;
-                    edge_span_count = span_count;
-                }
+    // edges between stop pairs go in the order of stop vertices
+    std::vector<BusEdge> edges;
+    edges.reserve(table.size());
+    for (const auto& [key, edge]: table) {
+        edges.push_back(edge);
+    }
+    std::sort(edges.begin(), edges.end(), [](const BusEdge& lhs, const BusEdge& rhs) {
+        return std::tie(lhs.from, lhs.to) < std::tie(rhs.from, rhs.to);
+    });
+
+    for (const auto& edge: edges) {
+        routes.AddEdge({edge.from, edge.to + stops_size, edge.time});
+        routing->edge2bus.emplace_back(edge.bus, edge.span_count);
+    }
+
+    // graph doesn't change after build, searches go over its packed copy
+    routing->graph = std::make_shared<FrozenGraph<double>>(routes);
+    const auto& graph = *routing->graph;
+    if (route_settings_->router_mode == Router<double>::Mode::CONTRACTION_HIERARCHY) {
+        routing->router = std::make_shared<Router<double>>(graph, LoadOrBuildHierarchy(graph));
+    } else if (route_settings_->router_mode == Router<double>::Mode::A_STAR && !HasRoadShorterThanLine()) {
+        routing->router = std::make_shared<Router<double>>(graph, MakeTimeLowerBound());
+    } else {
+        routing->router = std::make_shared<Router<double>>(graph, route_settings_->router_mode,
+                                                           route_settings_->router_matrix_weight);
+    }
+
+    std::atomic_store(&routing_, std::shared_ptr<const Routing>(std::move(routing)));
+}
+
+void DataBase::UpdateRoutes(BusId bus, const Route& route) {
+    const auto& routing = *routing_;
+
+    // a route with a stop without a location has no edges, as in BuildRoutes
+    const auto& stops = route.UniqueStops();
+    if (!std::all_of(stops.begin(), stops.end(), [this](StopId stop) { return compacted_->HasLocation(stop); })) {
+        return;
+    }
+
+    // a new stop renumbers vertices, a road shorter than the line breaks the A* bound
+    const bool known_stops = std::all_of(stops.begin(), stops.end(), [&routing](StopId stop) {
+        return routing.HasVertex(stop);
+    });
+    if (!known_stops || (route_settings_->router_mode == Router<double>::Mode::A_STAR
+                         && HasRoadShorterThanLine(route))) {
+        BuildRoutes();
+        return;
+    }
+
+    const auto stops_size = routing.vertex2stop.size();
+    std::vector<Edge<double>> new_edges;
+    std::vector<std::pair<BusId, int>> new_edge_buses;
+    std::unordered_map<size_t, size_t> pair_to_new_edge;
+    // edges as fast as the bus between the same stops name the first bus by name, as BuildRoutes does
+    std::unordered_map<EdgeId, std::pair<BusId, int>> renamed_edges;
+    ForEachBusEdge(route, routing, [&](VertexId v_from, VertexId v_to, double time, int span_count) {
+        std::optional<FrozenGraph<double>::IncidentEdge> best_edge;
+        for (const auto& edge: routing.graph->GetIncidentEdges(v_from)) {
+            if (edge.to == v_to + stops_size && (!best_edge || edge.weight < best_edge->weight)) best_edge = edge;
+        }
+
+        // only edges better than the ones between the same stops change routes
+        if (best_edge && best_edge->weight < time) return;
+        if (best_edge && best_edge->weight == time) {
+            const auto edge_bus = renamed_edges.count(best_edge->id) ? renamed_edges.at(best_edge->id).first
+                                                                     : routing.edge2bus[best_edge->id - stops_size].first;
+            if (bus_names_.Name(bus) < bus_names_.Name(edge_bus)) {
+                renamed_edges[best_edge->id] = {bus, span_count};
             }
+            return;
         }
+
+        auto [it, inserted] = pair_to_new_edge.insert({v_from * stops_size + v_to, new_edges.size()});
+        if (inserted) {
+            new_edges.push_back({v_from, v_to + stops_size, time});
+            new_edge_buses.emplace_back(bus, span_count);
+        } else if (new_edges[it->second].weight > time) {
+            new_edges[it->second].weight = time;
+            new_edge_buses[it->second].second = span_count;
+        }
+    });
+    if (new_edges.empty() && renamed_edges.empty()) return;
+
+    auto updated = std::make_shared<Routing>();
+    updated->compacted = compacted_;
+    updated->vertex2stop = routing.vertex2stop;
+    updated->stop_to_vertex = routing.stop_to_vertex;
+    updated->edge2bus = routing.edge2bus;
+    for (const auto& [edge_id, edge_bus]: renamed_edges) {
+        updated->edge2bus[edge_id - stops_size] = edge_bus;
+    }
+    updated->edge2bus.insert(updated->edge2bus.end(), new_edge_buses.begin(), new_edge_buses.end());
+    if (new_edges.empty()) {
+        updated->graph = routing.graph;
+        updated->router = routing.router;
+    } else {
+        updated->graph = std::make_shared<FrozenGraph<double>>(*routing.graph, new_edges);
+        updated->router = std::make_shared<Router<double>>(*routing.router, *updated->graph);
+    }
+
+    std::atomic_store(&routing_, std::shared_ptr<const Routing>(std::move(updated)));
+}
+
+bool DataBase::HasRoadShorterThanLine() const {
+    return std::any_of(buses_.begin(), buses_.end(), [this](const auto& route) {
+        return HasRoadShorterThanLine(*route);
+    });
+}
+
+bool DataBase::HasRoadShorterThanLine(const Route& route) const {
+    const auto& stops = route.Stops();
+    if (stops.empty()) return false;
+
+    for (size_t to = 1; to < stops.size(); ++to) {
+        // no edges go to a stop without a location
+        if (!compacted_->HasLocation(stops[to - 1]) || !compacted_->HasLocation(stops[to])) continue;
+        if (compacted_->Distance(stops[to - 1], stops[to]) < compacted_->LineDistance(stops[to - 1], stops[to])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Router<double>::LowerBound DataBase::MakeTimeLowerBound() const {
+    // vertices are numbered in stop name order, both vertices of a stop are at its location
+    GeoPoints vertex_points;
+    vertex_points.Reserve(compacted_->stops_by_name.size());
+    for (const auto stop: compacted_->stops_by_name) {
+        vertex_points.Add(compacted_->Location(stop));
     }
 
-    for (const auto& [edge_bus_number, edge_span_count, edge]: edge_hash) {
-        if (edge_span_count == 0) continue;
-        routes_->AddEdge(edge);
-        edge2bus_.emplace_back(edge_bus_number, edge_span_count);
+    // no bus is faster than bus_velocity, no road is shorter than the line between its stops
+    const double bus_velocity = route_settings_->bus_velocity;
+    return [vertex_points = std::move(vertex_points), bus_velocity](VertexId from, VertexId to) {
+        const auto stops_size = vertex_points.Size();
+        const double distance = vertex_points.Distance(from % stops_size, to % stops_size);
+        // cosine of coincident points can be rounded above 1, its acos is NaN
+        if (std::isnan(distance)) return 0.0;
+        return distance * LOWER_BOUND_SCALE / bus_velocity / 1000 * 60;
+    };
+}
+
+std::unique_ptr<ContractionHierarchy<double>> DataBase::LoadOrBuildHierarchy(const FrozenGraph<double>& graph) const {
+    const auto& file_name = route_settings_->hierarchy_file;
+    if (!file_name) return std::make_unique<ContractionHierarchy<double>>(graph);
+
+    if (std::ifstream input(*file_name, std::ios::binary); input) {
+        if (auto hierarchy = ContractionHierarchy<double>::Load(input, graph)) {
+            return hierarchy;
+        }
     }
 
-    router_ = std::make_unique<Router<double>>(*routes_);
+    auto hierarchy = std::make_unique<ContractionHierarchy<double>>(graph);
+    std::ofstream output(*file_name, std::ios::binary);
+    hierarchy->Save(output);
+    return hierarchy;
 }
 
 Svg::Document DataBase::BuildMap() const {
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cmath>
+
+#include "geodesic.h"
+
+namespace busdb {
+
+namespace {
+    constexpr size_t BLOCK_SIZE = 256;
+}
+
+void GeoPoints::Reserve(size_t count) {
+    sin_latitudes_.reserve(count);
+    cos_latitudes_.reserve(count);
+    longitudes_.reserve(count);
+}
+
+uint32_t GeoPoints::Add(Point point) {
+    point.ToRadians();
+    sin_latitudes_.push_back(std::sin(point.latitude));
+    cos_latitudes_.push_back(std::cos(point.latitude));
+    longitudes_.push_back(point.longitude);
+    return static_cast<uint32_t>(longitudes_.size() - 1);
+}
+
+size_t GeoPoints::Size() const {
+    return longitudes_.size();
+}
+
+DistanceType GeoPoints::Distance(uint32_t from, uint32_t to) const {
+    return std::acos(sin_latitudes_[from] * sin_latitudes_[to] + cos_latitudes_[from] * cos_latitudes_[to] *
+                std::cos(std::abs(longitudes_[from] - longitudes_[to]))) * Point::R;
+}
+
+void GeoPoints::Distances(const uint32_t* from, const uint32_t* to, size_t count, DistanceType* out) const {
+    const double* sin_latitudes = sin_latitudes_.data();
+    const double* cos_latitudes = cos_latitudes_.data();
+    const double* longitudes = longitudes_.data();
+    const double radius = Point::R;
+
+    // sin * sin + (cos * cos) * cos(dlon), as Distance adds them up
+    double sin_products[BLOCK_SIZE], cos_products[BLOCK_SIZE], arguments[BLOCK_SIZE];
+    for (size_t begin = 0; begin < count; begin += BLOCK_SIZE) {
+        const size_t size = std::min(BLOCK_SIZE, count - begin);
+        const uint32_t* block_from = from + begin;
+        const uint32_t* block_to = to + begin;
+
+        for (size_t i = 0; i < size; ++i) {
+            sin_products[i] = sin_latitudes[block_from[i]] * sin_latitudes[block_to[i]];
+            cos_products[i] = cos_latitudes[block_from[i]] * cos_latitudes[block_to[i]];
+            arguments[i] = std::abs(longitudes[block_from[i]] - longitudes[block_to[i]]);
+        }
+        for (size_t i = 0; i < size; ++i) {
+            arguments[i] = std::cos(arguments[i]);
+        }
+        for (size_t i = 0; i < size; ++i) {
+            arguments[i] = sin_products[i] + cos_products[i] * arguments[i];
+        }
+        for (size_t i = 0; i < size; ++i) {
+            out[begin + i] = std::acos(arguments[i]) * radius;
+        }
+    }
+}
+
+DistanceType GeoPoints::PathDistance(const std::vector<uint32_t>& points) const {
+    if (points.size() < 2) return {};
+
+    std::vector<DistanceType> distances(points.size() - 1);
+    Distances(points.data(), points.data() + 1, distances.size(), distances.data());
+
+    DistanceType res = {};
+    for (const auto distance: distances) {
+        res += distance;
+    }
+    return res;
+}
+
+}
@@ -1,106 +1,52 @@
-#include<sstream>
-#include<stdexcept>
+#include<algorithm>
+#include<charconv>
 #include<climits>
+#include<cstring>
+#include<fstream>
+#include<streambuf>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "json.h"
+#include "json_index.h"
+#include "numbers.h"
 
 namespace {
 
 using namespace Json;
 
-Node LoadNode(std::istream& input);
-
-Node LoadArray(std::istream& input) {
-    std::vector<Node> result;
-
-    for (char c; input >> c && c != ']';) {
-        if (c != ',') {
-            input.putback(c);
-        }
-        result.push_back(LoadNode(input));
-    }
-
-    return Node(move(result));
-}
-
-Node LoadInt(std::istream& input) {
-    int result = 0;
-    while (isdigit(input.peek())) {
-        result *= 10;
-        result += input.get() - '0';
-    }
-    return Node(result);
-}
-
-Node LoadString(std::istream& input) {
-    std::string line;
-    getline(input, line, '"');
-    return Node(move(line));
-}
-
-Node LoadObject(std::istream& input) {
-    std::map<std::string, Node> result;
-
-    for (char c; input >> c && c != '}';) {
-        if (c == ',') {
-            input >> c;
-        }
-
-        auto key = LoadString(input).AsString();
-        input >> c;
-        result.emplace(move(key), LoadNode(input));
-    }
-
-    return Node(move(result));
-}
-
-Node LoadLiteral(std::istream& input) {
-    std::stringstream ss;
-
-    for (char c; input >> c;) {
-        if (c == ',' || c == '}' || c == ']') {
-            input.putback(c);
-            break;
-        }
-        ss << c;
-    }
-
-    Node res;
-    if (auto s = ss.str();s.empty()) {
-        throw std::invalid_argument("empty");
-    } else if (s == "true") {
-        res = Node(true);
-    } else if (s == "false") {
-        res = Node(false);
-    } else {
-        auto value = stod(s);
-        res = (value >= 0 && value < INT_MAX && s.find('.') == std::string::npos) ?
-              Node(int(value)) : Node(value);
-    }
-
-    return res;
-}
-
-Node LoadNode(std::istream& input) {
-
-    char c;
-    input >> c;
-
-    if (c == '[') {
-        return LoadArray(input);
-    } else if (c == '{') {
-        return LoadObject(input);
-    } else if (c == '"') {
-        return LoadString(input);
+void AppendUtf8(std::string& result, uint32_t code) {
+    if (code < 0x80) {
+        result.push_back(char(code));
+    } else if (code < 0x800) {
+        result.push_back(char(0xC0 | (code >> 6)));
+        result.push_back(char(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        result.push_back(char(0xE0 | (code >> 12)));
+        result.push_back(char(0x80 | ((code >> 6) & 0x3F)));
+        result.push_back(char(0x80 | (code & 0x3F)));
     } else {
-        input.putback(c);
-        return LoadLiteral(input);
+        result.push_back(char(0xF0 | (code >> 18)));
+        result.push_back(char(0x80 | ((code >> 12) & 0x3F)));
+        result.push_back(char(0x80 | ((code >> 6) & 0x3F)));
+        result.push_back(char(0x80 | (code & 0x3F)));
     }
 }
 
 bool EqualWithSkip(const Node& left, const Node& right,
                    std::optional<std::unordered_set<std::string>> attr_to_skip = std::nullopt);
 
+bool KeyLess(const Object::Member& member, std::string_view key) {
+    return member.first < key;
+}
+
 bool EqualWithSkip(const Array& left, const Array& right,
                    std::optional<std::unordered_set<std::string>> attr_to_skip) {
     if(left.size() != right.size()) return false;
@@ -118,7 +64,7 @@ bool EqualWithSkip(const Object& left, const Object& right,
 
     for(const auto& [left_name, left_node]: left) {
         if(auto right_item_it = right.find(left_name); !(attr_to_skip &&
-                                                         attr_to_skip->count(left_name)) &&
+                                                         attr_to_skip->count(std::string(left_name))) &&
                                                        (right_item_it == right.end() ||
                                                         !(left_node == right_item_it->second))) {
             return false;
@@ -131,6 +77,8 @@ bool EqualWithSkip(const Object& left, const Object& right,
 bool EqualWithSkip(const Node& left, const Node& right,
                    std::optional<std::unordered_set<std::string>> attr_to_skip) {
 
+    if (left.IsString() && right.IsString())
+        return left.AsString() == right.AsString();
     if (left.index() != right.index())
         return false;
 
@@ -146,6 +94,7 @@ bool EqualWithSkip(const Node& left, const Node& right,
         case Node::Type::BooleanType:
             return left.AsBoolean() == right.AsBoolean();
         case Node::Type::StringType:
+        case Node::Type::StringViewType:
             return left.AsString() == right.AsString();
     }
 
@@ -156,16 +105,507 @@ bool EqualWithSkip(const Node& left, const Node& right,
 
 namespace Json {
 
+Object::Object(std::pmr::memory_resource* resource) :
+        members(resource) {
+}
+
+Object::Object(std::pmr::vector<Member> members) :
+        members(move(members)) {
+    auto& sorted = this->members;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Member& left, const Member& right) {
+        return left.first < right.first;
+    });
+    sorted.erase(std::unique(sorted.begin(), sorted.end(), [](const Member& left, const Member& right) {
+        return left.first == right.first;
+    }), sorted.end());
+}
+
+bool Object::emplace(std::string_view key, Node value) {
+    const auto it = std::lower_bound(members.begin(), members.end(), key, KeyLess);
+    if (it != members.end() && it->first == key) {
+        return false;
+    }
+    members.emplace(it, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(move(value)));
+    return true;
+}
+
+const Node& Object::at(std::string_view key) const {
+    if (const auto it = find(key); it != end()) {
+        return it->second;
+    }
+    throw std::out_of_range("no key " + std::string(key));
+}
+
+Object::const_iterator Object::find(std::string_view key) const {
+    const auto it = std::lower_bound(members.begin(), members.end(), key, KeyLess);
+    return it != members.end() && it->first == key ? it : members.end();
+}
+
+size_t Object::count(std::string_view key) const {
+    return find(key) != end();
+}
+
+Object::const_iterator Object::begin() const {
+    return members.begin();
+}
+
+Object::const_iterator Object::end() const {
+    return members.end();
+}
+
+size_t Object::size() const {
+    return members.size();
+}
+
+bool Object::empty() const {
+    return members.empty();
+}
+
+ParsingError::ParsingError(const std::string& what, size_t offset) :
+        std::runtime_error(what + " at byte " + std::to_string(offset)), offset(offset) {
+}
+
+size_t ParsingError::GetOffset() const {
+    return offset;
+}
+
+Buffer::Buffer(std::shared_ptr<const char> data, size_t size) :
+        data(move(data)), size(size) {
+}
+
+Buffer Buffer::FromFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        const size_t size = info.st_size;
+        if (void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0); memory != MAP_FAILED) {
+            close(fd);
+            madvise(memory, size, MADV_SEQUENTIAL);
+            return Buffer(std::shared_ptr<const char>(static_cast<const char*>(memory),
+                                                      [size](const char* memory) {
+                                                          munmap(const_cast<char*>(memory), size);
+                                                      }),
+                          size);
+        }
+    }
+    close(fd);
+
+    // pipes and empty files can not be mapped
+    std::ifstream input(path, std::ios::binary);
+    return FromStream(input);
+}
+
+Buffer Buffer::FromStream(std::istream& input) {
+    auto storage = std::make_shared<std::vector<char>>();
+    size_t size = 0;
+    for (size_t chunk = 1 << 16; input; chunk = storage->size()) {
+        storage->resize(size + chunk);
+        input.read(storage->data() + size, chunk);
+        size += input.gcount();
+    }
+
+    const char* data = storage->data();
+    return Buffer(std::shared_ptr<const char>(move(storage), data), size);
+}
+
+std::string_view Buffer::View() const {
+    return {data.get(), size};
+}
+
+Reader::Reader(std::string_view input, bool structural_index) :
+        begin(input.data()), pos(input.data()), end(input.data() + input.size()) {
+    if (structural_index) {
+        index = std::make_shared<StructuralIndex>(input);
+    }
+}
+
+void Reader::Fail(const std::string& what) const {
+    throw ParsingError(what, pos - begin);
+}
+
+const char* Reader::SkipSpaces() {
+    // single spaces between tokens are cheaper to step over
+    if (index && end - pos > 1 && (pos[1] == ' ' || pos[1] == '\n' || pos[1] == '\r' || pos[1] == '\t')) {
+        if (const auto next = index->NextToken(pos - begin)) {
+            pos = begin + *next;
+            return pos;
+        }
+    }
+    while (pos != end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) {
+        ++pos;
+    }
+    return pos;
+}
+
+char Reader::NextChar() {
+    if (SkipSpaces() == end) {
+        Fail("unexpected end of input");
+    }
+    return *pos;
+}
+
+void Reader::Expect(char c) {
+    if (NextChar() != c) {
+        Fail(std::string("expected '") + c + "'");
+    }
+    ++pos;
+}
+
+void Reader::BeginObject() {
+    Expect('{');
+    first_item = true;
+}
+
+void Reader::BeginArray() {
+    Expect('[');
+    first_item = true;
+}
+
+bool Reader::NextMember(char close) {
+    if (NextChar() == close) {
+        ++pos;
+        first_item = false;
+        return false;
+    }
+    if (!first_item) {
+        Expect(',');
+    }
+    first_item = false;
+    return true;
+}
+
+bool Reader::NextKey(std::string_view& key) {
+    if (!NextMember('}')) {
+        return false;
+    }
+    if (NextChar() != '"') {
+        Fail("expected a string key");
+    }
+    key = ParseString();
+    Expect(':');
+    return true;
+}
+
+bool Reader::NextItem() {
+    return NextMember(']');
+}
+
+std::string_view Reader::ReadString() {
+    if (NextChar() != '"') {
+        Fail("expected a string");
+    }
+    return ParseString();
+}
+
+int Reader::ReadInt() {
+    const char* const first = SkipSpaces();
+    auto node = ParseLiteral();
+    if ((Node::Type)node.index() != Node::Type::IntType) {
+        pos = first;
+        Fail("expected an int");
+    }
+    return node.AsInt();
+}
+
+double Reader::ReadDouble() {
+    const char* const first = SkipSpaces();
+    auto node = ParseLiteral();
+    if (auto type = (Node::Type)node.index(); type == Node::Type::IntType) {
+        return node.AsInt();
+    } else if (type != Node::Type::DoubleType) {
+        pos = first;
+        Fail("expected a number");
+    }
+    return node.AsDouble();
+}
+
+bool Reader::ReadBoolean() {
+    const char* const first = SkipSpaces();
+    auto node = ParseLiteral();
+    if ((Node::Type)node.index() != Node::Type::BooleanType) {
+        pos = first;
+        Fail("expected a boolean");
+    }
+    return node.AsBoolean();
+}
+
+Node Reader::ReadNode(std::pmr::memory_resource* resource) {
+    switch (NextChar()) {
+        // items are collected on the stacks and moved into containers of the exact size,
+        // so that no memory is left behind in an arena by growing containers
+        case '[': {
+            const size_t first = item_stack.size();
+            BeginArray();
+            while (NextItem()) {
+                auto item = ReadNode(resource);
+                item_stack.push_back(move(item));
+            }
+
+            Array result(resource);
+            result.reserve(item_stack.size() - first);
+            std::move(item_stack.begin() + first, item_stack.end(), std::back_inserter(result));
+            item_stack.resize(first);
+            return Node(move(result));
+        }
+        case '{': {
+            const size_t first = member_stack.size();
+            BeginObject();
+            for (std::string_view key; NextKey(key);) {
+                // the key may be in unescaped, which the value can overwrite
+                std::pmr::string name(key, resource);
+                auto value = ReadNode(resource);
+                member_stack.emplace_back(move(name), move(value));
+            }
+
+            std::pmr::vector<Object::Member> members(resource);
+            members.reserve(member_stack.size() - first);
+            std::move(member_stack.begin() + first, member_stack.end(), std::back_inserter(members));
+            member_stack.erase(member_stack.begin() + first, member_stack.end());
+            return Node(Object(move(members)));
+        }
+        case '"':
+            if (auto value = ParseString(); value.data() == unescaped.data()) {
+                return Node(std::pmr::string(value, resource));
+            } else {
+                return Node(value);
+            }
+        default:
+            return ParseLiteral();
+    }
+}
+
+void Reader::Skip() {
+    switch (NextChar()) {
+        case '[':
+            BeginArray();
+            while (NextItem()) {
+                Skip();
+            }
+            break;
+        case '{':
+            BeginObject();
+            for (std::string_view key; NextKey(key);) {
+                Skip();
+            }
+            break;
+        case '"':
+            ParseString();
+            break;
+        default:
+            ParseLiteral();
+    }
+}
+
+std::vector<std::pair<size_t, size_t>> Reader::FindArrayItems() {
+    Expect('[');
+    const char* const array = pos - 1;
+    // the scan starts outside of strings, at the opening bracket
+    StructuralIndex tokens({array, static_cast<size_t>(end - array)});
+    std::vector<std::pair<size_t, size_t>> items;
+
+    constexpr size_t NO_ITEM = -1;
+    size_t item_begin = NO_ITEM;
+    int depth = 1;
+    for (size_t token = 1;; ++token) {
+        token = *tokens.NextToken(token);
+        pos = array + token;
+        if (pos == end) {
+            Fail("unterminated array");
+        }
+
+        switch (*pos) {
+            case '[': case '{':
+                if (depth++ == 1 && item_begin == NO_ITEM) item_begin = token;
+                break;
+            case ']': case '}':
+                if (--depth > 0) break;
+                if (*pos != ']') {
+                    Fail("expected ']'");
+                }
+                if (item_begin != NO_ITEM) {
+                    items.emplace_back(item_begin, token);
+                } else if (!items.empty()) {
+                    Fail("expected an array item");
+                }
+                ++pos;
+                first_item = false;
+                for (auto& [item_first, item_last]: items) {
+                    item_first += array - begin;
+                    item_last += array - begin;
+                }
+                return items;
+            case ',':
+                if (depth > 1) break;
+                if (item_begin == NO_ITEM) {
+                    Fail("expected an array item");
+                }
+                items.emplace_back(item_begin, token);
+                item_begin = NO_ITEM;
+                break;
+            case ':':
+                break;
+            default:
+                // strings and literals
+                if (depth == 1 && item_begin == NO_ITEM) item_begin = token;
+        }
+    }
+}
+
+Reader Reader::Slice(size_t from, size_t to) const {
+    Reader slice(std::string_view(begin, end - begin));
+    slice.pos = begin + from;
+    slice.end = begin + to;
+    return slice;
+}
+
+void Reader::Finish() {
+    if (SkipSpaces() != end) {
+        Fail("unexpected data after the root value");
+    }
+}
+
+size_t Reader::GetOffset() const {
+    return pos - begin;
+}
+
+// pos is at the opening quote
+std::string_view Reader::ParseString() {
+    const char* const first = ++pos;
+    const auto* quote = static_cast<const char*>(memchr(first, '"', end - first));
+    if (!quote) {
+        Fail("unterminated string");
+    }
+    if (!memchr(first, '\\', quote - first)) {
+        pos = quote + 1;
+        return {first, size_t(quote - first)};
+    }
+
+    unescaped.clear();
+    while (true) {
+        const char* plain = pos;
+        while (pos != end && *pos != '"' && *pos != '\\') {
+            ++pos;
+        }
+        unescaped.append(plain, pos);
+        if (pos == end) {
+            Fail("unterminated string");
+        }
+        if (*pos++ == '"') {
+            return unescaped;
+        }
+        AppendEscaped();
+    }
+}
+
+// pos is after the backslash
+void Reader::AppendEscaped() {
+    if (pos == end) {
+        Fail("unterminated string");
+    }
+    switch (const char c = *pos++) {
+        case '"': case '\\': case '/':
+            unescaped.push_back(c);
+            break;
+        case 'b': unescaped.push_back('\b'); break;
+        case 'f': unescaped.push_back('\f'); break;
+        case 'n': unescaped.push_back('\n'); break;
+        case 'r': unescaped.push_back('\r'); break;
+        case 't': unescaped.push_back('\t'); break;
+        case 'u': {
+            uint32_t code = ParseHex4();
+            if (code >= 0xD800 && code < 0xDC00) {
+                if (end - pos < 2 || pos[0] != '\\' || pos[1] != 'u') {
+                    Fail("unpaired surrogate");
+                }
+                pos += 2;
+                const uint32_t low = ParseHex4();
+                if (low < 0xDC00 || low >= 0xE000) {
+                    Fail("unpaired surrogate");
+                }
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            AppendUtf8(unescaped, code);
+            break;
+        }
+        default:
+            --pos;
+            Fail("invalid escape");
+    }
+}
+
+uint32_t Reader::ParseHex4() {
+    if (end - pos < 4) {
+        Fail("invalid unicode escape");
+    }
+    uint32_t code = 0;
+    for (int i = 0; i < 4; ++i, ++pos) {
+        const char c = *pos;
+        code <<= 4;
+        if (c >= '0' && c <= '9') code |= c - '0';
+        else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+        else Fail("invalid unicode escape");
+    }
+    return code;
+}
+
+// true, false or a number; a non-negative number without a decimal point that fits int is int
+Node Reader::ParseLiteral() {
+    const char* const first = pos;
+    while (pos != end && *pos != ',' && *pos != '}' && *pos != ']' &&
+           *pos != ' ' && *pos != '\n' && *pos != '\r' && *pos != '\t') {
+        ++pos;
+    }
+    const std::string_view token(first, pos - first);
+
+    if (token == "true") {
+        return Node(true);
+    } else if (token == "false") {
+        return Node(false);
+    }
+
+    if (const auto value = Numbers::ParseInt(token); value && *value >= 0 && *value < INT_MAX) {
+        return Node(*value);
+    }
+
+    const auto value = Numbers::ParseDouble(token);
+    if (!value) {
+        pos = first;
+        Fail(token.empty() ? "expected a value" : "invalid literal");
+    }
+    return (*value >= 0 && *value < INT_MAX && token.find('.') == std::string_view::npos) ?
+           Node(int(*value)) : Node(*value);
+}
+
 Document::Document(Node root) :
         root(move(root)) {
 }
 
+Document::Document(Buffer buffer, std::unique_ptr<std::pmr::monotonic_buffer_resource> arena, const Node* root) :
+        buffer(std::move(buffer)), arena(move(arena)), arena_root(root) {
+}
+
 const Node& Document::GetRoot() const {
-    return root;
+    return arena_root ? *arena_root : *root;
+}
+
+Document Load(Buffer buffer) {
+    const auto input = buffer.View();
+    // the tree takes at least as much memory as its text
+    auto arena = std::make_unique<std::pmr::monotonic_buffer_resource>(std::max<size_t>(input.size(), 1024));
+
+    Reader reader(input);
+    auto* root = new (arena->allocate(sizeof(Node), alignof(Node))) Node(reader.ReadNode(arena.get()));
+    reader.Finish();
+    return Document(std::move(buffer), move(arena), root);
 }
 
 Document Load(std::istream& input) {
-    return Document { LoadNode(input) };
+    return Load(Buffer::FromStream(input));
 }
 
 std::ostream& operator<<(std::ostream& output, const Node& node) {
@@ -200,12 +640,13 @@ std::ostream& operator<<(std::ostream& output, const Node& node) {
         output << node.AsInt();
         break;
     case Node::Type::DoubleType:
-        output << node.AsDouble();
+        output << Numbers::Double{node.AsDouble()};
         break;
     case Node::Type::BooleanType:
         output << (node.AsBoolean() ? "true" : "false");
         break;
     case Node::Type::StringType:
+    case Node::Type::StringViewType:
         output << '"' << node.AsString() << '"';
         break;
     }
@@ -217,6 +658,194 @@ void Save(const Document& document, std::ostream& output) {
     output << document.GetRoot();
 }
 
+namespace {
+constexpr size_t WRITER_BUFFER_SIZE = 1 << 16;
+constexpr size_t ESCAPING_CHUNK_SIZE = 1 << 12;
+
+// position of the first quote or backslash, text size if there is none
+size_t FindEscapable(std::string_view text) {
+    size_t pos = 0;
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\');
+    for (; pos + 32 <= text.size(); pos += 32) {
+        const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+        const auto mask = uint32_t(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chars, quote), _mm256_cmpeq_epi8(chars, backslash))));
+        if (mask) return pos + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+    for (; pos + 16 <= text.size(); pos += 16) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+        const auto mask = uint32_t(_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash))));
+        if (mask) return pos + __builtin_ctz(mask);
+    }
+#endif
+    for (; pos < text.size(); ++pos) {
+        if (text[pos] == '"' || text[pos] == '\\') return pos;
+    }
+    return text.size();
+}
+}
+
+// Collects what a stream prints in a small chunk and escapes it into the writer chunk by chunk
+class Writer::EscapingBuffer: public std::streambuf {
+public:
+    explicit EscapingBuffer(Writer& writer) :
+            writer(writer) {
+        setp(chunk, chunk + ESCAPING_CHUNK_SIZE);
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        sync();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        writer.AppendEscaped({pbase(), static_cast<size_t>(pptr() - pbase())});
+        setp(chunk, chunk + ESCAPING_CHUNK_SIZE);
+        return 0;
+    }
+
+private:
+    Writer& writer;
+    char chunk[ESCAPING_CHUNK_SIZE];
+};
+
+Writer::Writer(std::ostream& output) :
+        output(output), precision(static_cast<int>(output.precision())) {
+    buffer.reserve(WRITER_BUFFER_SIZE);
+}
+
+Writer::~Writer() {
+    Flush();
+}
+
+void Writer::BeginValue() {
+    if (after_key) {
+        after_key = false;
+    } else if (!first_items.empty()) {
+        if (!first_items.back()) {
+            buffer += ", ";
+        }
+        first_items.back() = false;
+    }
+}
+
+Writer& Writer::BeginArray() {
+    BeginValue();
+    buffer += '[';
+    first_items.push_back(true);
+    return *this;
+}
+
+Writer& Writer::EndArray() {
+    buffer += ']';
+    EndContainer();
+    return *this;
+}
+
+Writer& Writer::BeginObject() {
+    BeginValue();
+    buffer += '{';
+    first_items.push_back(true);
+    return *this;
+}
+
+Writer& Writer::EndObject() {
+    if (!first_items.back()) {
+        buffer += '\n';
+    }
+    buffer += "}\n";
+    EndContainer();
+    return *this;
+}
+
+void Writer::EndContainer() {
+    first_items.pop_back();
+    if (buffer.size() >= WRITER_BUFFER_SIZE) {
+        Flush();
+    }
+}
+
+Writer& Writer::Key(std::string_view key) {
+    if (!first_items.back()) {
+        buffer += ",\n";
+    }
+    first_items.back() = false;
+    buffer += '"';
+    buffer += key;
+    buffer += "\": ";
+    after_key = true;
+    return *this;
+}
+
+Writer& Writer::Int(int value) {
+    BeginValue();
+    char digits[16];
+    buffer.append(digits, std::to_chars(std::begin(digits), std::end(digits), value).ptr);
+    return *this;
+}
+
+Writer& Writer::Double(double value) {
+    BeginValue();
+    Numbers::AppendDouble(buffer, value, precision);
+    return *this;
+}
+
+Writer& Writer::Boolean(bool value) {
+    BeginValue();
+    buffer += value ? "true" : "false";
+    return *this;
+}
+
+Writer& Writer::String(std::string_view value) {
+    BeginValue();
+    buffer += '"';
+    buffer += value;
+    buffer += '"';
+    return *this;
+}
+
+Writer& Writer::EscapedString(const std::function<void(std::ostream&)>& write) {
+    BeginValue();
+    buffer += '"';
+    {
+        EscapingBuffer escaping(*this);
+        std::ostream out(&escaping);
+        write(out);
+        out.flush();
+    }
+    buffer += '"';
+    return *this;
+}
+
+void Writer::AppendEscaped(std::string_view text) {
+    while (!text.empty()) {
+        const size_t plain = FindEscapable(text);
+        buffer.append(text.data(), plain);
+        if (plain == text.size()) break;
+
+        buffer += '\\';
+        buffer += text[plain];
+        text.remove_prefix(plain + 1);
+    }
+    if (buffer.size() >= WRITER_BUFFER_SIZE) {
+        Flush();
+    }
+}
+
+void Writer::Flush() {
+    output.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
 bool EqualWithSkip(const Document& left, const Document& right,
                    std::optional<std::unordered_set<std::string>> attr_to_skip) {
     return ::EqualWithSkip(left.GetRoot(), right.GetRoot(), attr_to_skip);
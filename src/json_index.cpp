@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__PCLMUL__)
+#include <immintrin.h>
+#endif
+
+#include "json_index.h"
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 64;
+constexpr size_t WINDOW_SIZE = 1 << 16;
+
+// one bit per character of a block
+struct BlockMasks {
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t whitespace = 0;
+    uint64_t op = 0;
+};
+
+#ifdef __AVX2__
+uint64_t ToMask(__m256i low, __m256i high) {
+    return uint64_t(uint32_t(_mm256_movemask_epi8(high))) << 32 | uint32_t(_mm256_movemask_epi8(low));
+}
+
+__m256i AnyOf(__m256i chars, std::initializer_list<char> wanted) {
+    __m256i result = _mm256_setzero_si256();
+    for (char c: wanted) {
+        result = _mm256_or_si256(result, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(c)));
+    }
+    return result;
+}
+
+BlockMasks Classify(const char* block) {
+    const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+
+    BlockMasks masks;
+    masks.quote = ToMask(AnyOf(low, {'"'}), AnyOf(high, {'"'}));
+    masks.backslash = ToMask(AnyOf(low, {'\\'}), AnyOf(high, {'\\'}));
+    masks.whitespace = ToMask(AnyOf(low, {' ', '\n', '\r', '\t'}), AnyOf(high, {' ', '\n', '\r', '\t'}));
+    masks.op = ToMask(AnyOf(low, {'{', '}', '[', ']', ':', ','}), AnyOf(high, {'{', '}', '[', ']', ':', ','}));
+    return masks;
+}
+#else
+BlockMasks Classify(const char* block) {
+    BlockMasks masks;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        const uint64_t bit = uint64_t(1) << i;
+        switch (block[i]) {
+            case '"':
+                masks.quote |= bit;
+                break;
+            case '\\':
+                masks.backslash |= bit;
+                break;
+            case ' ': case '\n': case '\r': case '\t':
+                masks.whitespace |= bit;
+                break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                masks.op |= bit;
+                break;
+        }
+    }
+    return masks;
+}
+#endif
+
+// bit i is the xor of bits [0, i]
+uint64_t PrefixXor(uint64_t bits) {
+#ifdef __PCLMUL__
+    return _mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, bits), _mm_set1_epi8(-1), 0));
+#else
+    for (int shift = 1; shift < 64; shift *= 2) {
+        bits ^= bits << shift;
+    }
+    return bits;
+#endif
+}
+
+// characters following odd-length runs of backslashes, runs may continue from the previous block
+uint64_t FindEscaped(uint64_t backslash, uint64_t& prev_odd_backslash) {
+    constexpr uint64_t even_bits = 0x5555555555555555ull;
+    constexpr uint64_t odd_bits = ~even_bits;
+
+    const uint64_t start_edges = backslash & ~(backslash << 1);
+    const uint64_t even_start_mask = even_bits ^ prev_odd_backslash;
+    const uint64_t even_starts = start_edges & even_start_mask;
+    const uint64_t odd_starts = start_edges & ~even_start_mask;
+    const uint64_t even_carries = backslash + even_starts;
+
+    uint64_t odd_carries = backslash + odd_starts;
+    const bool ends_odd_backslash = odd_carries < backslash;
+    odd_carries |= prev_odd_backslash;
+    prev_odd_backslash = ends_odd_backslash ? 1 : 0;
+
+    const uint64_t even_carry_ends = even_carries & ~backslash;
+    const uint64_t odd_carry_ends = odd_carries & ~backslash;
+    return (even_carry_ends & odd_bits) | (odd_carry_ends & even_bits);
+}
+}
+
+namespace Json {
+
+StructuralIndex::StructuralIndex(std::string_view input) :
+        input(input) {
+}
+
+std::optional<size_t> StructuralIndex::FindNextToken(size_t pos) {
+    if (pos < window_begin) {
+        return std::nullopt;
+    }
+    // a copy of the reader may have looked ahead
+    if (cursor > 0 && positions[cursor - 1] >= pos) {
+        cursor = std::lower_bound(positions.begin(), positions.begin() + cursor, pos) - positions.begin();
+    }
+
+    while (true) {
+        while (cursor < positions.size() && positions[cursor] < pos) {
+            ++cursor;
+        }
+        if (cursor < positions.size()) {
+            return positions[cursor];
+        }
+        if (window_end == input.size()) {
+            return input.size();
+        }
+        IndexWindow();
+    }
+}
+
+bool StructuralIndex::IsVectorized() {
+#ifdef __AVX2__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void StructuralIndex::IndexWindow() {
+    window_begin = window_end;
+    window_end = std::min(input.size(), window_begin + WINDOW_SIZE);
+    positions.clear();
+    positions.reserve(WINDOW_SIZE);
+    cursor = 0;
+
+    size_t block_begin = window_begin;
+    for (; block_begin + BLOCK_SIZE <= window_end; block_begin += BLOCK_SIZE) {
+        IndexBlock(input.data() + block_begin, block_begin);
+    }
+    if (block_begin < window_end) {
+        // the tail of the input, padded with spaces
+        char block[BLOCK_SIZE];
+        memset(block, ' ', BLOCK_SIZE);
+        memcpy(block, input.data() + block_begin, window_end - block_begin);
+        IndexBlock(block, block_begin);
+    }
+}
+
+void StructuralIndex::IndexBlock(const char* block, size_t block_begin) {
+    const auto masks = Classify(block);
+
+    const uint64_t quote = masks.quote & ~FindEscaped(masks.backslash, prev_odd_backslash);
+    // opening quotes and string interiors
+    const uint64_t in_string = PrefixXor(quote) ^ prev_in_string;
+    prev_in_string = uint64_t(int64_t(in_string) >> 63);
+    // string interiors and closing quotes
+    const uint64_t string_tail = in_string ^ quote;
+
+    const uint64_t scalar = ~(masks.op | masks.whitespace);
+    const uint64_t follows_scalar = scalar << 1 | prev_scalar;
+    prev_scalar = scalar >> 63;
+
+    uint64_t starts = (masks.op | (scalar & ~follows_scalar)) & ~string_tail;
+    const size_t count = positions.size();
+    positions.resize(count + __builtin_popcountll(starts));
+    for (size_t* out = positions.data() + count; starts; starts &= starts - 1) {
+        *out++ = block_begin + __builtin_ctzll(starts);
+    }
+}
+}
@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <mutex>
+
+#include "name_pool.h"
+
+namespace busdb {
+
+NameId NamePool::Intern(std::string_view name) {
+    // the interning thread is the only one that changes ids_, it reads them without the lock
+    if (auto it = ids_.find(name); it != ids_.end()) {
+        return it->second;
+    }
+
+    const auto id = static_cast<NameId>(size_);
+    const auto [block, offset] = Locate(id);
+    if (!blocks_[block]) {
+        blocks_[block] = std::make_unique<std::string_view[]>(FIRST_BLOCK_SIZE << block);
+    }
+    blocks_[block][offset] = storage_.emplace_back(name);
+    ++size_;
+
+    std::unique_lock lock(ids_mutex_);
+    ids_.emplace(blocks_[block][offset], id);
+    return id;
+}
+
+std::optional<NameId> NamePool::Find(std::string_view name) const {
+    std::shared_lock lock(ids_mutex_);
+    if (auto it = ids_.find(name); it != ids_.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+size_t NamePool::Size() const {
+    return size_;
+}
+
+void NamePool::SortByName(std::vector<NameId>& ids) const {
+    std::sort(ids.begin(), ids.end(), [this](NameId lhs, NameId rhs) {
+        return Name(lhs) < Name(rhs);
+    });
+}
+
+}
@@ -0,0 +1,58 @@
+#include <charconv>
+#include <sstream>
+
+#include "numbers.h"
+
+namespace {
+
+template <typename Number>
+std::optional<Number> Parse(std::string_view text) {
+    Number value{};
+    const auto [last, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || last != text.data() + text.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+}
+
+namespace Numbers {
+
+std::optional<int> ParseInt(std::string_view text) {
+    return Parse<int>(text);
+}
+
+std::optional<double> ParseDouble(std::string_view text) {
+    return Parse<double>(text);
+}
+
+std::ostream& operator<<(std::ostream& out, Double number) {
+    // padding and non-default float formats are left to the stream
+    constexpr auto custom_flags = std::ios::floatfield | std::ios::showpoint | std::ios::showpos | std::ios::uppercase;
+    if (out.width() != 0 || (out.flags() & custom_flags)) {
+        return out << number.value;
+    }
+
+    char buffer[64];
+    const auto [last, error] = std::to_chars(std::begin(buffer), std::end(buffer), number.value,
+                                             std::chars_format::general, static_cast<int>(out.precision()));
+    if (error != std::errc()) {
+        return out << number.value;
+    }
+    return out.write(buffer, last - buffer);
+}
+
+void AppendDouble(std::string& out, double value, int precision) {
+    char buffer[64];
+    const auto [last, error] = std::to_chars(std::begin(buffer), std::end(buffer), value,
+                                             std::chars_format::general, precision);
+    if (error != std::errc()) {
+        std::ostringstream stream;
+        stream.precision(precision);
+        stream << value;
+        out += stream.str();
+        return;
+    }
+    out.append(buffer, last);
+}
+}
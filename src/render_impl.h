@@ -16,8 +16,8 @@ namespace {
                 return {Svg::Rgba{arr[0].AsInt(), arr[1].AsInt(), arr[2].AsInt(), arr[3].AsDouble()}};
             }
         }
-        else if (type == Node::Type::StringType) {
-            return {node.AsString()};
+        else if (node.IsString()) {
+            return {std::string(node.AsString())};
         }
 
         return Svg::NoneColor;
@@ -33,7 +33,7 @@ namespace {
         std::vector<std::string> res;
         res.reserve(arr.size());
         std::transform(std::begin(arr), std::end(arr), std::back_inserter(res), [](const auto& item){
-            return item.AsString();
+            return std::string(item.AsString());
         });
 
         return res;
@@ -51,16 +51,14 @@ namespace {
 namespace busdb {
 
     class DataBase::Render {
+        // neighbours on bus routes by stop id, a stop may be repeated
         auto GetAdjustedStops() const {
-            std::unordered_map <std::string_view, std::unordered_set<std::string_view>> adjusted_stops;
-            for (const auto&[_, route]: buses_) {
-                auto route_line = route->Stops();
-                if (route_line.size() < 2) continue;
-
-                auto it1 = std::begin(route_line);
-                for (auto it2 = it1++; it1 != std::end(route_line); ++it2, ++it1) {
-                    adjusted_stops[**it1].insert(**it2);
-                    adjusted_stops[**it2].insert(**it1);
+            std::vector<std::vector<StopId>> adjusted_stops(compacted_->StopCount());
+            for (const auto bus: buses_) {
+                const auto& route_line = compacted_->buses[bus]->Stops();
+                for (size_t i = 1; i < route_line.size(); ++i) {
+                    adjusted_stops[route_line[i]].push_back(route_line[i - 1]);
+                    adjusted_stops[route_line[i - 1]].push_back(route_line[i]);
                 }
             }
 
@@ -68,63 +66,72 @@ namespace busdb {
         }
 
         auto SmoothStops() const {
-            std::unordered_set <std::string_view> pivot_stops;
+            const auto stops_count = compacted_->StopCount();
+            std::vector<bool> pivot_stops(stops_count);
             {
-                std::unordered_map<std::string_view, int> bus_count;
-                std::unordered_map <std::string_view, Buses::mapped_type> first_bus;
-                for (const auto&[_, route]: buses_) {
-                    for (auto it: route->Stops()) {
-                        const auto &c_stop = *it;
-                        if (auto[pos, inserted] = first_bus.emplace(c_stop, route);
-                                !inserted && pos->second != route)
-                            bus_count[c_stop] += 10;
-
-                        bus_count[c_stop] += 1;
+                std::vector<int> bus_count(stops_count);
+                std::vector<const Route*> first_bus(stops_count);
+                for (const auto bus: buses_) {
+                    const auto* route = compacted_->buses[bus].get();
+                    for (const auto stop: route->Stops()) {
+                        if (!first_bus[stop])
+                            first_bus[stop] = route;
+                        else if (first_bus[stop] != route)
+                            bus_count[stop] += 10;
+
+                        bus_count[stop] += 1;
                     }
 
-                    for (auto item: route->EdgeStops())
-                        pivot_stops.insert(*item);
+                    for (const auto stop: route->EdgeStops())
+                        pivot_stops[stop] = true;
                 }
 
-                for (const auto&[stop, _]: stops_) {
+                for (const auto stop: stops_) {
                     if (auto count = bus_count[stop]; count == 0 || count > 2)
-                        pivot_stops.insert(stop);
+                        pivot_stops[stop] = true;
                 }
             }
 
-            std::unordered_map <std::string_view, Svg::Point> res;
-            for (const auto&[stop, point]: stops_) {
-                if (pivot_stops.count(stop)) {
-                    res[stop] = {point.longitude, point.latitude};
+            // points by stop id and stops in the order they got their points
+            std::pair<std::vector<std::optional<Svg::Point>>, std::vector<StopId>> res;
+            auto& [points, order] = res;
+            points.resize(stops_count);
+            const auto set_point = [&points, &order](StopId stop, Svg::Point point) {
+                if (!points[stop]) order.push_back(stop);
+                points[stop] = point;
+            };
+
+            for (const auto stop: stops_) {
+                if (pivot_stops[stop]) {
+                    const auto point = compacted_->Location(stop);
+                    set_point(stop, {point.longitude, point.latitude});
                 }
             }
 
-            for (const auto&[_, route]: buses_) {
-                auto line_route = route->Stops();
+            for (const auto bus: buses_) {
+                const auto& line_route = compacted_->buses[bus]->Stops();
                 if (line_route.empty())
                     continue;
 
-                auto it = std::begin(line_route), end = std::end(line_route);
-                std::list to_smooth = {*it};
-                for (++it; it != end; ++it) {
-                    const auto &stop = **it;
-                    if (pivot_stops.count(stop) == 0) {
-                        to_smooth.push_back(*it);
+                std::vector<StopId> to_smooth = {line_route.front()};
+                for (size_t i = 1; i < line_route.size(); ++i) {
+                    const auto stop = line_route[i];
+                    if (!pivot_stops[stop]) {
+                        to_smooth.push_back(stop);
                         continue;
                     }
 
                     if (const auto n = to_smooth.size(); n > 1) {
-                        const auto ps = stops_.at(*to_smooth.front()), pe = stops_.at(stop);
+                        const auto ps = compacted_->Location(to_smooth.front()), pe = compacted_->Location(stop);
                         const double lon_step = (pe.longitude - ps.longitude) / n;
                         const double lat_step = (pe.latitude - ps.latitude) / n;
 
-                        auto pos = std::begin(to_smooth);
                         for (int i = 1; i < n; ++i) {
-                            res[**(++pos)] = {ps.longitude + lon_step * i, ps.latitude + lat_step * i};
+                            set_point(to_smooth[i], {ps.longitude + lon_step * i, ps.latitude + lat_step * i});
                         }
                     }
 
-                    to_smooth = {*it};
+                    to_smooth = {stop};
                 }
             }
 
@@ -132,37 +139,36 @@ namespace busdb {
         }
 
         void ToSvgPoints() {
-            if (not stops2points_.empty()) return;
+            if (not stop_points_.empty()) return;
 
-            const auto stops = SmoothStops();
-            if (stops.size() != stops_.size()) throw int(1);
+            const auto [stops, order] = SmoothStops();
+            if (order.size() != stops_.size()) throw int(1);
 
-            std::vector <std::pair<Svg::Point, std::string_view>> points;
-            points.reserve(stops.size());
-            std::transform(std::begin(stops), std::end(stops), std::back_inserter(points),
-                           [](const auto &pair) { return std::make_pair(pair.second, pair.first); });
+            std::vector <std::pair<Svg::Point, StopId>> points;
+            points.reserve(stops_.size());
+            for (const auto stop: order) {
+                points.emplace_back(*stops[stop], stop);
+            }
 
-            static auto GetIndexes = [](auto &points, const auto &adjusted_stops, auto key) {
-                std::sort(std::begin(points), std::end(points),
-                          [key](auto &l, auto &r) { return key(l) < key(r); });
+            // stops with equal coordinates go in name order
+            const auto GetIndexes = [this](auto &points, const auto &adjusted_stops, auto key) {
+                std::sort(std::begin(points), std::end(points), [this, key](auto &l, auto &r) {
+                    if (key(l) != key(r)) return key(l) < key(r);
+                    return db_.stop_names_.Name(l.second) < db_.stop_names_.Name(r.second);
+                });
 
-                const auto stop2pos = [&points]() {
-                    std::unordered_map<std::string_view, int> res;
-                    for (int i = 0; i < points.size(); ++i) {
-                        res[points[i].second] = i;
-                    }
-                    return res;
-                }();
+                std::vector<int> stop2pos(adjusted_stops.size(), -1);
+                for (int i = 0; i < points.size(); ++i) {
+                    stop2pos[points[i].second] = i;
+                }
 
                 const auto n = points.size();
                 std::vector<int> indexes(n, -1);
                 for (size_t i = 0; i < n; ++i) {
                     auto[_, current_stop] = points[i];
                     int idx = -1;
-                    if (auto it = adjusted_stops.find(current_stop); it != std::end(adjusted_stops)) {
-                        for (auto adjusted_stop: it->second) {
-                            idx = std::max(idx, indexes[stop2pos.at(adjusted_stop)]);
-                        }
+                    for (auto adjusted_stop: adjusted_stops[current_stop]) {
+                        idx = std::max(idx, indexes[stop2pos[adjusted_stop]]);
                     }
 
                     indexes[i] = idx + 1;
@@ -196,15 +202,14 @@ namespace busdb {
                     key_y(points[i]) = render_settings_.height - render_settings_.padding - indexes[i] * y_step;
             }
 
-            for (auto[p, name]: points)
-                stops2points_.insert({name, p});
+            stop_points_.resize(stops.size());
+            for (auto[p, stop]: points)
+                stop_points_[stop] = p;
         }
 
     public:
-        using Stops = decltype(DataBase::stops_);
-        using Buses = decltype(DataBase::buses_);
-
-        Render(const Json::Object &s, const Stops &stops, const Buses &buses) : stops_(stops), buses_(buses) {
+        Render(const Json::Object &s, const DataBase &db) : db_(db), compacted_(db.compacted_),
+                                                             stops_(compacted_->stops_by_name), buses_(compacted_->buses_by_name) {
             render_settings_ = {.width = GetDouble(s.at("width")),
                     .height = GetDouble(s.at("height")),
                     .padding = GetDouble(s.at("padding")),
@@ -223,8 +228,9 @@ namespace busdb {
 
             int i = 0;
             const auto n = render_settings_.color_palette.size();
-            for (const auto& [name, _]: buses_) {
-                buses2colors_[name] =  render_settings_.color_palette[(i++) % n];
+            bus_colors_.resize(compacted_->buses.size());
+            for (const auto bus: buses_) {
+                bus_colors_[bus] =  render_settings_.color_palette[(i++) % n];
             }
 
             ToSvgPoints();
@@ -250,24 +256,26 @@ namespace busdb {
             map.Add(std::move(rect));
         }
 
-        void AddRoute(Svg::Document& map, const StopsRoute& route) const {
-            std::vector<std::string> items;
-            items.reserve(route.size());
-            std::transform(std::begin(route), std::end(route), std::back_inserter(items),
-                           [](const auto& item){return std::string(std::get<2>(item));});
+        // Items are ids of the route stops and buses in turn, ending with the last stop, `compacted` has them all.
+        // Stops and buses added after the map was laid out have no place on it, route parts with them are left out
+        void AddRoute(Svg::Document& map, const Compacted& compacted, const std::vector<NameId>& items,
+                      const StopsRoute& route) const {
+            const auto on_map = [this, &items](size_t bus_idx) {
+                return items[bus_idx] < bus_colors_.size() && items[bus_idx - 1] < stop_points_.size()
+                       && items[bus_idx + 1] < stop_points_.size();
+            };
 
-            std::list<std::string_view> full_route;
-            std::list<Svg::Polyline> polylines;
+            std::vector<StopId> full_route;
+            std::vector<Svg::Polyline> polylines;
             {
-                for (int i = 1; i < items.size(); i += 2) {
-                    const auto& bus_number = items[i];
-                    std::string_view start_stop = items[i - 1], stop_stop = items[i + 1];
+                for (size_t i = 1; i < items.size(); i += 2) {
+                    if (!on_map(i)) continue;
+                    const BusId bus = items[i];
+                    const StopId start_stop = items[i - 1], stop_stop = items[i + 1];
 
                     decltype(full_route) part;
                     const auto span_count = std::get<3>(route[i]);
-                    const auto bus_route = buses_.at(bus_number);
-                    for (auto it: bus_route->Stops()) {
-                        const auto& current_stop = *it;
+                    for (const auto current_stop: compacted.buses[bus]->Stops()) {
                         if (!part.empty()) part.push_back(current_stop);
                         if (current_stop == start_stop) {
                             part.clear();
@@ -276,16 +284,16 @@ namespace busdb {
 
                             if (!part.empty() && part.size() == span_count + 1) {
                                 Svg::Polyline polyline;
-                                polyline.SetStrokeColor(buses2colors_.at(bus_number))
+                                polyline.SetStrokeColor(bus_colors_[bus])
                                 .SetStrokeWidth(render_settings_.line_width)
                                 .SetStrokeLineCap(round_stroke)
                                 .SetStrokeLineJoin(round_stroke);
                                 for (auto stop: part) {
-                                    polyline.AddPoint(stops2points_.at(stop));
+                                    polyline.AddPoint(stop_points_[stop]);
                                 }
                                 polylines.push_back(std::move(polyline));
 
-                                full_route.splice(std::end(full_route), std::move(part));
+                                full_route.insert(std::end(full_route), std::begin(part), std::end(part));
                                 break;
                             }
                         }
@@ -302,41 +310,46 @@ namespace busdb {
                 }
                 else if (layer == "bus_labels")
                 {
-                    for (int i = 1; i < items.size(); i += 2) {
-                        const auto &bus_number = items[i], first_stop = items[i - 1],
-                                last_stop = items[i + 1];
-                        auto [bus_first_stop, bus_last_stop] = buses_.at(bus_number)->EdgeStops();
+                    for (size_t i = 1; i < items.size(); i += 2) {
+                        if (!on_map(i)) continue;
+                        const auto bus = items[i], first_stop = items[i - 1], last_stop = items[i + 1];
+                        auto [bus_first_stop, bus_last_stop] = compacted.buses[bus]->EdgeStops();
 
-                        if (first_stop == *bus_first_stop || first_stop == *bus_last_stop) {
-                            RenderBusLabel(map, bus_number, first_stop);
+                        if (first_stop == bus_first_stop || first_stop == bus_last_stop) {
+                            RenderBusLabel(map, bus, first_stop);
                         }
 
-                        if (first_stop != last_stop && (last_stop == *bus_last_stop || last_stop == *bus_first_stop)) {
-                            RenderBusLabel(map, bus_number, last_stop);
+                        if (first_stop != last_stop && (last_stop == bus_last_stop || last_stop == bus_first_stop)) {
+                            RenderBusLabel(map, bus, last_stop);
                         }
                     }
                 }
                 else if (layer == "stop_points")
                 {
-                    for (auto stop_name: full_route) {
+                    for (auto stop: full_route) {
                         map.Add(Svg::Circle{}.SetFillColor("white")
-                                        .SetRadius(render_settings_.stop_radius).SetCenter(stops2points_.at(stop_name)));
+                                        .SetRadius(render_settings_.stop_radius).SetCenter(stop_points_[stop]));
                     }
                 }
                 else if (layer == "stop_labels")
                 {
-                    for (int i = 0; i < items.size(); i += 2) {
-                        RenderStopLabel(map, items[i]);
+                    for (size_t i = 0; i < items.size(); i += 2) {
+                        if (items[i] < stop_points_.size()) RenderStopLabel(map, items[i]);
                     }
                 }
             }
         }
 
     private:
-        const Stops& stops_;
-        const Buses& buses_;
-        std::map<std::string_view, Svg::Point> stops2points_;
-        std::unordered_map<std::string_view, Svg::Color> buses2colors_;
+        const DataBase& db_;
+        // stops and buses as they were when the map was laid out
+        const std::shared_ptr<const Compacted> compacted_;
+        // stops with a location and all buses, in name order
+        const std::vector<StopId> stops_;
+        const std::vector<BusId> buses_;
+        // by stop id and by bus id
+        std::vector<Svg::Point> stop_points_;
+        std::vector<Svg::Color> bus_colors_;
         static const std::unordered_map<std::string, void (Render::*)(Svg::Document &) const> LAYER_ACTIONS;
 
         struct RenderSettings {
@@ -355,29 +368,29 @@ namespace busdb {
         RenderSettings render_settings_;
 
         void RenderBusLines(Svg::Document &map) const {
-            for (const auto&[name, route]: buses_) {
+            for (const auto bus: buses_) {
                 Svg::Polyline polyline;
 
-                polyline.SetStrokeColor(buses2colors_.at(name)).
+                polyline.SetStrokeColor(bus_colors_[bus]).
                         SetStrokeWidth(render_settings_.line_width).SetStrokeLineCap(round_stroke).SetStrokeLineJoin(
                         round_stroke);
 
-                for (auto stop: route->Stops()) {
-                    polyline.AddPoint(stops2points_.at(*stop));
+                for (auto stop: compacted_->buses[bus]->Stops()) {
+                    polyline.AddPoint(stop_points_[stop]);
                 }
 
                 map.Add(std::move(polyline));
             }
         }
 
-        void RenderBusLabel(Svg::Document &map, const std::string& bus_number, std::string_view stop_name) const {
+        void RenderBusLabel(Svg::Document &map, BusId bus, StopId stop) const {
             Svg::Text background;
-            background.SetData(bus_number).SetFontFamily("Verdana").SetFontSize(render_settings_.bus_label_font_size).
+            background.SetData(std::string(db_.bus_names_.Name(bus))).SetFontFamily("Verdana").SetFontSize(render_settings_.bus_label_font_size).
                     SetFontWeight("bold").SetOffset(render_settings_.bus_label_offset).SetPoint(
-                    stops2points_.at(stop_name));
+                    stop_points_[stop]);
 
             auto text = background;
-            text.SetFillColor(buses2colors_.at(bus_number));
+            text.SetFillColor(bus_colors_[bus]);
 
             background.SetStrokeLineCap(round_stroke).SetStrokeLineJoin(round_stroke).
                     SetStrokeWidth(render_settings_.underlayer_width).
@@ -389,26 +402,26 @@ namespace busdb {
         }
 
         void RenderBusLabels(Svg::Document &map) const {
-            for (const auto&[name, route]: buses_) {
-                const auto[first_stop, last_stop] = route->EdgeStops();
+            for (const auto bus: buses_) {
+                const auto[first_stop, last_stop] = compacted_->buses[bus]->EdgeStops();
 
-                RenderBusLabel(map, name, *first_stop);
+                RenderBusLabel(map, bus, first_stop);
                 if (first_stop != last_stop) {
-                    RenderBusLabel(map, name, *last_stop);
+                    RenderBusLabel(map, bus, last_stop);
                 }
             }
         }
 
         void RenderStopPoints(Svg::Document &map) const {
-            for (auto[_, point]: stops2points_) {
-                map.Add(Svg::Circle{}.SetFillColor("white").SetRadius(render_settings_.stop_radius).SetCenter(point));
+            for (const auto stop: stops_) {
+                map.Add(Svg::Circle{}.SetFillColor("white").SetRadius(render_settings_.stop_radius).SetCenter(stop_points_[stop]));
             }
         }
 
-        void RenderStopLabel(Svg::Document &map, const std::string& name) const {
+        void RenderStopLabel(Svg::Document &map, StopId stop) const {
             Svg::Text background;
-            background.SetData(name).SetFontFamily("Verdana").SetFontSize(render_settings_.stop_label_font_size).
-                    SetOffset(render_settings_.stop_label_offset).SetPoint(stops2points_.at(name));
+            background.SetData(std::string(db_.stop_names_.Name(stop))).SetFontFamily("Verdana").SetFontSize(render_settings_.stop_label_font_size).
+                    SetOffset(render_settings_.stop_label_offset).SetPoint(stop_points_[stop]);
 
             auto text = background;
             text.SetFillColor("black");
@@ -423,8 +436,8 @@ namespace busdb {
         }
 
         void RenderStopLabels(Svg::Document &map) const {
-            for (const auto&[name, _]: stops_) {
-                RenderStopLabel(map, name);
+            for (const auto stop: stops_) {
+                RenderStopLabel(map, stop);
             }
         }
     };
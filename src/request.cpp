@@ -1,11 +1,13 @@
+#include<algorithm>
 #include<unordered_map>
 #include<map>
+#include<stdexcept>
 #include<string>
-#include<set>
-#include <sstream>
+#include<vector>
 
 #include "request.h"
 #include "common.h"
+#include "parallel.h"
 #include "route.h"
 #include "svg.h"
 
@@ -15,51 +17,56 @@ namespace
 {
 using namespace busdb;
 
-std::string MapToStr(const Svg::Document& map) {
-    std::ostringstream ss;
-    ss << map;
-
-    std::string temp = ss.str(), res;
-    res.reserve(temp.size());
-    for (auto c: temp) {
-        if (c == '"' || c == '\\') {
-            res.push_back('\\');
-        }
-        res.push_back(c);
-    }
-
-    return res;
+void WriteNotFound(Writer& writer, int request_id) {
+    writer.BeginObject();
+    writer.Key("error_message").String("not found");
+    writer.Key("request_id").Int(request_id);
+    writer.EndObject();
 }
 
 struct BusData: AbstractData {
     std::string name;
-    std::shared_ptr<Route> route;
+    std::optional<RouteStats> stats;
 
-    BusData(int request_id, std::string name, std::shared_ptr<Route> route) :
-            AbstractData(request_id), name(move(name)), route(route) {
+    BusData(int request_id, std::string name, std::optional<RouteStats> stats) :
+            AbstractData(request_id), name(move(name)), stats(stats) {
     }
 
     std::ostream& toStream(std::ostream& out) const override {
         out << "Bus " << name << ": ";
-        if (!route)
+        if (!stats)
             out << "not found";
         else
-            out << *route;
+            out << *stats;
 
         return out;
     }
 
-    Object toJsonObject() const override {
-        return route ? route->ToJsonObject() : Object {{"error_message", "not found" } };
+    void toJson(Writer& writer) const override {
+        if (!stats) {
+            WriteNotFound(writer, request_id);
+            return;
+        }
+
+        const auto distance = stats->length;
+        writer.BeginObject();
+        writer.Key("curvature").Double(stats->curvature);
+        writer.Key("request_id").Int(request_id);
+        writer.Key("route_length");
+        if (distance - int(distance) > 0) writer.Double(distance);
+        else writer.Int(int(distance));
+        writer.Key("stop_count").Int(stats->stop_count);
+        writer.Key("unique_stop_count").Int(stats->unique_stop_count);
+        writer.EndObject();
     }
 };
 
 struct StopData: AbstractData {
     std::string name;
-    std::optional<std::set<std::string_view>> buses;
+    std::optional<std::vector<std::string_view>> buses;
 
     StopData(int request_id, std::string name, decltype(buses) buses) :
-            AbstractData(request_id), name(move(name)), buses(buses) {
+            AbstractData(request_id), name(move(name)), buses(move(buses)) {
     }
 
     std::ostream& toStream(std::ostream& out) const override {
@@ -77,16 +84,20 @@ struct StopData: AbstractData {
         return out;
     }
 
-    Object toJsonObject() const override {
-        if (!buses)
-            return { {"error_message", "not found"}};
+    void toJson(Writer& writer) const override {
+        if (!buses) {
+            WriteNotFound(writer, request_id);
+            return;
+        }
 
-        auto b = Array();
+        writer.BeginObject();
+        writer.Key("buses").BeginArray();
         for (const auto& bus : *(buses)) {
-            b.push_back(std::string(bus));
+            writer.String(bus);
         }
-
-        return {{"buses", move(b)}};
+        writer.EndArray();
+        writer.Key("request_id").Int(request_id);
+        writer.EndObject();
     }
 };
 
@@ -102,30 +113,37 @@ struct RouteData: AbstractData {
         return out;
     }
 
-    Object toJsonObject() const override {
+    void toJson(Writer& writer) const override {
         const auto& [total_time, route, map] = data;
-        if (total_time < 0) return {{"error_message", "not found" }};
+        if (total_time < 0) {
+            WriteNotFound(writer, request_id);
+            return;
+        }
 
-        Object res  = {{"total_time",  total_time}};
-        Array items;
+        writer.BeginObject();
+        writer.Key("items").BeginArray();
         for(const auto& [type, time, name, span_count]: route) {
-            Object item = {{"type", TypeToString(type)}, {"time", time}};
+            writer.BeginObject();
             if(type == DataBase::RouteItemType::BUS) {
-                item["bus"] = std::string(name);
-                item["span_count"] = span_count;
+                writer.Key("bus").String(name);
+                writer.Key("span_count").Int(span_count);
             } else if (type == DataBase::RouteItemType::WAIT) {
-                item["stop_name"] = std::string(name);
+                writer.Key("stop_name").String(name);
             }
-            items.push_back(move(item));
+            writer.Key("time").Double(time);
+            writer.Key("type").String(TypeToString(type));
+            writer.EndObject();
         }
-
-        res["items"] = move(items);
-        res["map"] = MapToStr(map);
-
-        return res;
+        writer.EndArray();
+        writer.Key("map").EscapedString([&svg = map](std::ostream& out) {
+            out << svg;
+        });
+        writer.Key("request_id").Int(request_id);
+        writer.Key("total_time").Double(total_time);
+        writer.EndObject();
     }
 
-    std::string TypeToString(DataBase::RouteItemType type) const {
+    std::string_view TypeToString(DataBase::RouteItemType type) const {
         return type == DataBase::RouteItemType::BUS ? "Bus" : "Wait";
     }
 };
@@ -142,8 +160,13 @@ struct MapData: AbstractData {
         return out << map;
     }
 
-    Object toJsonObject() const override {
-        return {{"map", MapToStr(map)}};
+    void toJson(Writer& writer) const override {
+        writer.BeginObject();
+        writer.Key("map").EscapedString([this](std::ostream& out) {
+            out << map;
+        });
+        writer.Key("request_id").Int(request_id);
+        writer.EndObject();
     }
 };
 
@@ -163,12 +186,23 @@ struct BusReadRequest: ReadRequest {
         name = std::string(input);
     }
 
-    void ParseOther(const Object& data) override {
-        name = data.at("name").AsString();
+    bool ParseField(std::string_view key, Reader& reader) override {
+        switch (KeyHash(key)) {
+            case KeyHash("name"):
+                if (key != "name") break;
+                name = reader.ReadString();
+                return true;
+        }
+        return ReadRequest::ParseField(key, reader);
+    }
+
+    void FinishParsing() override {
+        ReadRequest::FinishParsing();
+        Require("name");
     }
 
     std::unique_ptr<AbstractData> Process(const DataBase& db) const override {
-        return std::make_unique<BusData>(id, name, db.GetBusRoute(name));
+        return std::make_unique<BusData>(id, name, db.GetBusStats(name));
     }
 
     std::string name;
@@ -182,8 +216,19 @@ struct StopReadRequest: ReadRequest {
         name = std::string(input);
     }
 
-    void ParseOther(const Object& data) override {
-        name = data.at("name").AsString();
+    bool ParseField(std::string_view key, Reader& reader) override {
+        switch (KeyHash(key)) {
+            case KeyHash("name"):
+                if (key != "name") break;
+                name = reader.ReadString();
+                return true;
+        }
+        return ReadRequest::ParseField(key, reader);
+    }
+
+    void FinishParsing() override {
+        ReadRequest::FinishParsing();
+        Require("name");
     }
 
     std::unique_ptr<AbstractData> Process(const DataBase& db) const override {
@@ -201,9 +246,24 @@ struct RouteReadRequest: ReadRequest {
         // do nothing,
     }
 
-    void ParseOther(const Object& data) override {
-        from = data.at("from").AsString();
-        to = data.at("to").AsString();
+    bool ParseField(std::string_view key, Reader& reader) override {
+        switch (KeyHash(key)) {
+            case KeyHash("from"):
+                if (key != "from") break;
+                from = reader.ReadString();
+                return true;
+            case KeyHash("to"):
+                if (key != "to") break;
+                to = reader.ReadString();
+                return true;
+        }
+        return ReadRequest::ParseField(key, reader);
+    }
+
+    void FinishParsing() override {
+        ReadRequest::FinishParsing();
+        Require("from");
+        Require("to");
     }
 
     std::unique_ptr<AbstractData> Process(const DataBase& db) const override {
@@ -220,9 +280,6 @@ struct MapReadRequest: ReadRequest {
     void ParseFrom(std::string_view input) override {
     }
 
-    void ParseOther(const Object& data) override {
-    }
-
     std::unique_ptr<AbstractData> Process(const DataBase& db) const override {
         return std::make_unique<MapData>(id, db.BuildMap());
     }
@@ -245,15 +302,43 @@ struct StopModifyRequest: ModifyRequest {
         }
     }
 
-    void ParseFrom(const Object& data) override {
-        name = data.at("name").AsString();
-        auto &latitude = data.at("latitude"), &longitude = data.at("longitude");
-        position = {latitude.index() == (int)Node::Type::DoubleType ? latitude.AsDouble() : latitude.AsInt(),
-                    longitude.index() == (int)Node::Type::DoubleType ? longitude.AsDouble() : longitude.AsInt()};
-
-        for (auto& [stop_name, distance] : data.at("road_distances").AsObject()) {
-            distances.push_back({stop_name, distance.AsInt()});
+    bool ParseField(std::string_view key, Reader& reader) override {
+        switch (KeyHash(key)) {
+            case KeyHash("name"):
+                if (key != "name") break;
+                name = reader.ReadString();
+                return true;
+            case KeyHash("latitude"):
+                if (key != "latitude") break;
+                position.latitude = reader.ReadDouble();
+                return true;
+            case KeyHash("longitude"):
+                if (key != "longitude") break;
+                position.longitude = reader.ReadDouble();
+                return true;
+            case KeyHash("road_distances"):
+                if (key != "road_distances") break;
+                reader.BeginObject();
+                for (std::string_view stop_name; reader.NextKey(stop_name);) {
+                    // the first of repeated keys counts, as in Json::Object
+                    if (std::any_of(distances.begin(), distances.end(), [stop_name](const auto& distance) {
+                        return distance.first == stop_name;
+                    })) {
+                        reader.Skip();
+                        continue;
+                    }
+                    distances.push_back({std::string(stop_name), reader.ReadInt()});
+                }
+                return true;
         }
+        return false;
+    }
+
+    void FinishParsing() override {
+        Require("name");
+        Require("latitude");
+        Require("longitude");
+        Require("road_distances");
     }
 
     void Process(DataBase& db) const override {
@@ -274,9 +359,32 @@ struct BusModifyRequest: ModifyRequest {
         route = Route::ParseRoute(input);
     }
 
-    void ParseFrom(const Object& data) override {
-        name = data.at("name").AsString();
-        route = Route::ParseRoute(data);
+    bool ParseField(std::string_view key, Reader& reader) override {
+        switch (KeyHash(key)) {
+            case KeyHash("name"):
+                if (key != "name") break;
+                name = reader.ReadString();
+                return true;
+            case KeyHash("stops"):
+                if (key != "stops") break;
+                reader.BeginArray();
+                while (reader.NextItem()) {
+                    stops.emplace_back(reader.ReadString());
+                }
+                return true;
+            case KeyHash("is_roundtrip"):
+                if (key != "is_roundtrip") break;
+                is_roundtrip = reader.ReadBoolean();
+                return true;
+        }
+        return false;
+    }
+
+    void FinishParsing() override {
+        Require("name");
+        Require("stops");
+        Require("is_roundtrip");
+        route = Route::ParseRoute(move(stops), is_roundtrip);
     }
 
     void Process(DataBase& db) const override {
@@ -285,6 +393,9 @@ struct BusModifyRequest: ModifyRequest {
 
     std::string name;
     std::shared_ptr<Route> route;
+    // until the whole object is read
+    std::vector<std::string> stops;
+    bool is_roundtrip = false;
 };
 
 }
@@ -295,12 +406,6 @@ AbstractData::AbstractData(int request_id) :
         request_id(request_id) {
 }
 
-Node AbstractData::toJson() const {
-    auto res = toJsonObject();
-    res["request_id"] = request_id;
-    return res;
-}
-
 std::ostream& operator<<(std::ostream& out, const AbstractData& data) {
     return data.toStream(out);
 }
@@ -316,9 +421,56 @@ std::optional<Request::Type> ConvertRequestTypeFromString(std::string_view type_
     return std::nullopt;
 }
 
-void ReadRequest::ParseFrom(const Object& data) {
-    id = data.at("id").AsInt();
-    ParseOther(data);
+std::optional<Request::Type> FindJsonRequestType(Reader reader) {
+    reader.BeginObject();
+    for (std::string_view key; reader.NextKey(key);) {
+        if (key == "type") {
+            return ConvertRequestTypeFromString(reader.ReadString());
+        }
+        reader.Skip();
+    }
+    return std::nullopt;
+}
+
+void Request::ParseFrom(Reader& reader) {
+    reader.BeginObject();
+    for (std::string_view key; reader.NextKey(key);) {
+        if (ParseField(key, reader)) {
+            parsed_members_.push_back(KeyHash(key));
+        } else {
+            reader.Skip();
+        }
+    }
+    FinishParsing();
+    parsed_members_ = {};
+}
+
+bool Request::ParseField(std::string_view key, Reader& reader) {
+    return false;
+}
+
+void Request::FinishParsing() {
+}
+
+void Request::Require(std::string_view member) const {
+    // ParseField compares keys, a member it took is the one its hash names
+    if (std::find(parsed_members_.begin(), parsed_members_.end(), KeyHash(member)) == parsed_members_.end()) {
+        throw std::out_of_range("no key " + std::string(member));
+    }
+}
+
+void ReadRequest::FinishParsing() {
+    Require("id");
+}
+
+bool ReadRequest::ParseField(std::string_view key, Reader& reader) {
+    switch (KeyHash(key)) {
+        case KeyHash("id"):
+            if (key != "id") break;
+            id = reader.ReadInt();
+            return true;
+    }
+    return false;
 }
 
 std::unique_ptr<ModifyRequest> ModifyRequest::Create(Request::Type type) {
@@ -332,6 +484,84 @@ std::unique_ptr<ModifyRequest> ModifyRequest::Create(Request::Type type) {
     return nullptr;
 }
 
+void ReadRequest::ProcessAll(const std::list<std::unique_ptr<ReadRequest>>& requests, const DataBase& db,
+                             const std::function<void(const AbstractData&)>& write) {
+    std::vector<const ReadRequest*> indexed_requests;
+    indexed_requests.reserve(requests.size());
+    for (const auto& request: requests) {
+        indexed_requests.push_back(request.get());
+    }
+
+    // requests are processed on all threads a window at a time, the responses of a window are written
+    // in request order before the next one starts, so only a window of responses is held
+    const size_t threads = Parallel::ThreadCount();
+    const size_t window = threads * 64;
+    constexpr size_t NO_GROUP = -1;
+
+    // route requests of the window grouped by the route source, a group is answered at its first request.
+    // Tasks fill responses of different requests, the database is only read
+    std::unordered_map<std::string_view, size_t> source_to_group;
+    std::vector<std::vector<size_t>> groups;
+    // request index and its group, NO_GROUP for requests other than Route
+    std::vector<std::pair<size_t, size_t>> tasks;
+    std::vector<std::unique_ptr<AbstractData>> responses(std::min(window, requests.size()));
+    for (size_t window_begin = 0; window_begin < requests.size(); window_begin += window) {
+        const size_t window_end = std::min(window_begin + window, requests.size());
+        source_to_group.clear();
+        groups.clear();
+        tasks.clear();
+        for (size_t idx = window_begin; idx < window_end; ++idx) {
+            if (indexed_requests[idx]->type != Type::ROUTE) {
+                tasks.emplace_back(idx, NO_GROUP);
+                continue;
+            }
+
+            const auto& route_request = static_cast<const RouteReadRequest&>(*indexed_requests[idx]);
+            auto [it, inserted] = source_to_group.insert({route_request.from, groups.size()});
+            if (inserted) {
+                groups.emplace_back();
+                tasks.emplace_back(idx, it->second);
+            }
+            groups[it->second].push_back(idx);
+        }
+
+        const auto process = [&](size_t idx, size_t group_idx) {
+            if (group_idx == NO_GROUP) {
+                responses[idx - window_begin] = indexed_requests[idx]->Process(db);
+                return;
+            }
+
+            const auto& group = groups[group_idx];
+            const auto route_request = [&indexed_requests](size_t request_idx) {
+                return static_cast<const RouteReadRequest*>(indexed_requests[request_idx]);
+            };
+            std::vector<std::string_view> to;
+            to.reserve(group.size());
+            for (const auto request_idx: group) {
+                to.push_back(route_request(request_idx)->to);
+            }
+
+            auto routes = db.GetRoutes(route_request(idx)->from, to);
+            for (size_t i = 0; i < group.size(); ++i) {
+                responses[group[i] - window_begin] = std::make_unique<RouteData>(route_request(group[i])->id,
+                                                                                 std::move(routes[i]));
+            }
+        };
+
+        Parallel::ForDynamicChunks(0, tasks.size(), tasks.size() / (threads * 8),
+                                   [&tasks, &process](size_t begin, size_t end) {
+            for (size_t task = begin; task < end; ++task) {
+                process(tasks[task].first, tasks[task].second);
+            }
+        });
+
+        for (size_t idx = window_begin; idx < window_end; ++idx) {
+            write(*responses[idx - window_begin]);
+            responses[idx - window_begin].reset();
+        }
+    }
+}
+
 std::unique_ptr<ReadRequest> ReadRequest::Create(Request::Type type) {
     switch (type) {
         case Request::Type::BUS:
@@ -12,7 +12,7 @@ DistanceType Distance(Iterator begin, Iterator end, Function func) {
     DistanceType res = { };
     if (auto it_to = begin; it_to != end) {
         for (auto it_from = it_to++; it_to != end; ++it_to, ++it_from) {
-            res += func(*(*it_from), *(*it_to));
+            res += func(*it_from, *it_to);
         }
     }
 
@@ -23,8 +23,12 @@ class CircleRoute: public Route {
 public:
     static std::string delimiter;
 
-    std::array<StopsContainer::const_iterator, 2> EdgeStops() const override {
-        return {*std::cbegin(route_), *std::cbegin(route_)};
+    std::array<StopId, 2> EdgeStops() const override {
+        return {route_.front(), route_.front()};
+    }
+
+    bool IsRoundtrip() const override {
+        return true;
     }
 
 protected:
@@ -38,12 +42,16 @@ protected:
 };
 
 class TwoWayRoute: public Route {
-    StopsContainer::const_iterator last_stop_;
+    StopId last_stop_ = 0;
 public:
     static std::string delimiter;
 
-    std::array<StopsContainer::const_iterator, 2> EdgeStops() const override {
-        return {*std::cbegin(route_), last_stop_};
+    std::array<StopId, 2> EdgeStops() const override {
+        return {route_.front(), last_stop_};
+    }
+
+    bool IsRoundtrip() const override {
+        return false;
     }
 
 protected:
@@ -52,9 +60,10 @@ protected:
     }
 
     void FillRoute() override {
-        last_stop_ = *route_.rbegin();
-        if (route_.size() >= 2)
-            copy(++route_.rbegin(), route_.rend(), back_inserter(route_));
+        last_stop_ = route_.back();
+        route_.reserve(route_.size() * 2);
+        for (size_t i = route_.size() - 1; i-- > 0;)
+            route_.push_back(route_[i]);
     }
 };
 std::string CircleRoute::delimiter = " > ";
@@ -67,29 +76,49 @@ namespace busdb {
 void Route::ParseFrom(std::string_view stops) {
     auto delimiter = Delimiter();
     while (stops.size()) {
-        auto [it, inserted] = stops_.insert(std::string(ReadToken(stops, delimiter)));
-        route_.push_back(it);
+        stop_names_.emplace_back(ReadToken(stops, delimiter));
     }
-    FillRoute();
 }
 
-void Route::ParseFrom(const Json::Object& data) {
-    for (const auto& item : data.at("stops").AsArray()) {
-        auto [it, inserted] = stops_.insert(item.AsString());
-        route_.push_back(it);
+void Route::ParseFrom(std::vector<std::string> stops) {
+    stop_names_ = move(stops);
+}
+
+void Route::SetDB(const DataBase* db, NamePool& stop_names) {
+    std::vector<StopId> stops;
+    stops.reserve(stop_names_.size());
+    for (const auto& name : stop_names_) {
+        stops.push_back(stop_names.Intern(name));
     }
-    FillRoute();
+    stop_names_ = {};
+
+    SetStops(db, move(stops));
 }
 
-void Route::SetDB(const DataBase* db) {
+void Route::SetStops(const DataBase* db, std::vector<StopId> stops) {
     db_ = db;
+    route_ = move(stops);
+
+    stops_ = route_;
+    std::sort(stops_.begin(), stops_.end());
+    stops_.erase(std::unique(stops_.begin(), stops_.end()), stops_.end());
+
+    if (!route_.empty())
+        FillRoute();
+}
+
+std::vector<StopId> Route::BaseStops() const {
+    if (IsRoundtrip() || route_.empty())
+        return route_;
+
+    return {route_.begin(), route_.begin() + route_.size() / 2 + 1};
 }
 
-const Route::StopsContainer& Route::UniqueStops() const {
+const std::vector<StopId>& Route::UniqueStops() const {
     return stops_;
 }
 
-const std::list<Route::StopsContainer::const_iterator>& Route::Stops() const {
+const std::vector<StopId>& Route::Stops() const {
     return route_;
 }
 
@@ -99,27 +128,27 @@ DistanceType Route::Distance() const {
 }
 
 DistanceType Route::LineDistance() const {
-    return ::Distance(route_.cbegin(), route_.cend(),
-                      [this](const auto& from, const auto& to) {return this->db_->LineDistance(from, to);});
+    return db_->LineDistance(route_);
 }
 
-Json::Object Route::ToJsonObject() const {
-    auto distance = Distance();
-    Json::Object json = {{"curvature", distance / LineDistance()},
-            {"stop_count", (int)Stops().size()},
-            {"unique_stop_count", (int)UniqueStops().size()}};
-
-    if (distance - int(distance) > 0) json["route_length"] = distance;
-    else json["route_length"] = int(distance);
+RouteStats Route::Stats() const {
+    return Stats(Distance(), LineDistance());
+}
 
-    return json;
+RouteStats Route::Stats(DistanceType length, DistanceType line_length) const {
+    RouteStats stats;
+    stats.length = length;
+    stats.line_length = line_length;
+    stats.curvature = stats.length / stats.line_length;
+    stats.stop_count = route_.size();
+    stats.unique_stop_count = stops_.size();
+    return stats;
 }
 
-std::ostream& operator<<(std::ostream& out, const Route& r) {
-    auto distance = r.Distance();
-    return out << r.Stops().size() << " stops on route, " << r.UniqueStops().size()
-            << " unique stops, " << int(distance) << " route length, "
-            << distance / r.LineDistance() << " curvature";
+std::ostream& operator<<(std::ostream& out, const RouteStats& stats) {
+    return out << stats.stop_count << " stops on route, " << stats.unique_stop_count
+            << " unique stops, " << int(stats.length) << " route length, "
+            << stats.curvature << " curvature";
 }
 
 std::unique_ptr<Route> Route::ParseRoute(std::string_view route_str) {
@@ -137,18 +166,18 @@ std::unique_ptr<Route> Route::ParseRoute(std::string_view route_str) {
     return route;
 }
 
-std::unique_ptr<Route> Route::ParseRoute(const Json::Object& data) {
-    std::unique_ptr<Route> route = nullptr;
-
-    if (data.at("is_roundtrip").AsBoolean()) {
-        route = std::make_unique<CircleRoute>();
-    } else {
-        route = std::make_unique<TwoWayRoute>();
-    }
-
-    route->ParseFrom(data);
+std::unique_ptr<Route> Route::ParseRoute(std::vector<std::string> stops, bool is_roundtrip) {
+    auto route = Create(is_roundtrip);
+    route->ParseFrom(move(stops));
 
     return route;
 }
 
+std::unique_ptr<Route> Route::Create(bool is_roundtrip) {
+    if (is_roundtrip) {
+        return std::make_unique<CircleRoute>();
+    }
+    return std::make_unique<TwoWayRoute>();
+}
+
 }
@@ -1,11 +1,14 @@
 #include "svg.h"
+#include "numbers.h"
 
 #include <algorithm>
 #include <iterator>
 
+using Numbers::Double;
+
 namespace Svg {
     std::ostream& operator<<(std::ostream& out, Svg::Point p) {
-        return out << p.x << ',' << p.y;
+        return out << Double{p.x} << ',' << Double{p.y};
     }
 
     std::ostream& operator<<(std::ostream& out, const Svg::Rgb& rgb) {
@@ -13,7 +16,7 @@ namespace Svg {
     }
 
     std::ostream& operator<<(std::ostream& out, const Svg::Rgba& rgba) {
-        return out<<"rgba(" << rgba.red << ',' << rgba.green << ',' << rgba.blue << ',' << rgba.alpha << ')';
+        return out<<"rgba(" << rgba.red << ',' << rgba.green << ',' << rgba.blue << ',' << Double{rgba.alpha} << ')';
     }
 
     std::ostream& operator<<(std::ostream& out, std::monostate) {
@@ -31,7 +34,7 @@ namespace Svg {
         out << "\" ";
         out << "stroke=\"" << object.stroke_color_;
         out << "\" ";
-        out << "stroke-width=\"" << object.stroke_width_ << "\" ";
+        out << "stroke-width=\"" << Double{object.stroke_width_} << "\" ";
         if (object.stroke_line_cap_) {
             out << "stroke-linecap=\"" << *object.stroke_line_cap_ << "\" ";
         }
@@ -43,9 +46,9 @@ namespace Svg {
 
     std::ostream& operator<<(std::ostream& out, const Circle& circle) {
         out << "<circle ";
-        out << "cx=\"" << circle.center_.x << "\" ";
-        out << "cy=\"" << circle.center_.y << "\" ";
-        out << "r=\"" << circle.radius_ << "\" ";
+        out << "cx=\"" << Double{circle.center_.x} << "\" ";
+        out << "cy=\"" << Double{circle.center_.y} << "\" ";
+        out << "r=\"" << Double{circle.radius_} << "\" ";
 
         return out << static_cast<const BaseObject<Circle>&>(circle) << "/>";
     }
@@ -66,10 +69,10 @@ namespace Svg {
 
     std::ostream& operator<<(std::ostream& out, const Text& text) {
         out << "<text ";
-        out << "x=\"" << text.point_.x << "\" ";
-        out << "y=\"" << text.point_.y << "\" ";
-        out << "dx=\"" << text.offset_.x << "\" ";
-        out << "dy=\"" << text.offset_.y << "\" ";
+        out << "x=\"" << Double{text.point_.x} << "\" ";
+        out << "y=\"" << Double{text.point_.y} << "\" ";
+        out << "dx=\"" << Double{text.offset_.x} << "\" ";
+        out << "dy=\"" << Double{text.offset_.y} << "\" ";
         out << "font-size=\"" << text.font_size_ << "\" ";
         if (text.font_family_) {
             out << "font-family=\"" << *text.font_family_ << "\" ";
@@ -92,10 +95,10 @@ namespace Svg {
 
     std::ostream& operator<<(std::ostream& out, const Rect& rect) {
         out << "<rect ";
-        out << "x=\"" << rect.tl_.x << "\" ";
-        out << "y=\"" << rect.tl_.y << "\" ";
-        out << "width=\"" << rect.br_.x - rect.tl_.x << "\" ";
-        out << "height=\"" << rect.br_.y - rect.tl_.y << "\" ";
+        out << "x=\"" << Double{rect.tl_.x} << "\" ";
+        out << "y=\"" << Double{rect.tl_.y} << "\" ";
+        out << "width=\"" << Double{rect.br_.x - rect.tl_.x} << "\" ";
+        out << "height=\"" << Double{rect.br_.y - rect.tl_.y} << "\" ";
 
         return out << static_cast<const BaseObject<Rect>&>(rect) << "/>";
     }